@@ -1,48 +1,96 @@
 #include "board.hpp"
 
 /*
- * Make a standard 8x8 othello board and initialize it to the standard setup.
+ * Static weight of each square. Read-only and shared by every board, so
+ * copies stay cheap and concurrent games can use it without locking.
  */
-Board::Board() {
-    taken.set(3 + 8 * 3);
-    taken.set(3 + 8 * 4);
-    taken.set(4 + 8 * 3);
-    taken.set(4 + 8 * 4);
-    black.set(4 + 8 * 3);
-    black.set(3 + 8 * 4);
+static const int staticWeights[8][8] = {{4, -3, 2, 2, 2, 2, -3, 4},
+                                        {-3, -4, -1, -1, -1, -1, -4, -3},
+                                        {2, -1, 1, 0, 0, 1, -1, 2},
+                                        {2, -1, 0, 1, 1, 0, -1, 2},
+                                        {2, -1, 0, 1, 1, 0, -1, 2},
+                                        {2, -1, 1, 0, 0, 1, -1, 2},
+                                        {-3, -4, -1, -1, -1, -1, -4, -3},
+                                        {4, -3, 2, 2, 2, 2, -3, 4}};
+
+/*
+ * Static weight of square (x, y) on an N x N board. Smaller boards have no
+ * tuned table, so use the same pattern by distance from the edges: corners
+ * good, squares next to corners bad, edges good, second row poor.
+ */
+template <int N>
+static int squareWeight(int x, int y) {
+    int dx = min(x, N - 1 - x);
+    int dy = min(y, N - 1 - y);
+    int edge = min(dx, dy);
+    int along = max(dx, dy);
+
+    if (edge == 0)
+        return (along == 0) ? 4 : (along == 1) ? -3 : 2;
+    if (edge == 1)
+        return (along == 1) ? -4 : -1;
+    return 0;
+}
+
+template <>
+int squareWeight<8>(int x, int y) {
+    return staticWeights[x][y];
+}
+
+/*
+ * Make an N x N othello board and initialize it to the standard setup.
+ */
+template <int N>
+BasicBoard<N>::BasicBoard() {
+    const int c = N / 2;
+    taken = black = 0;
+    set(WHITE, c - 1, c - 1);
+    set(WHITE, c, c);
+    set(BLACK, c, c - 1);
+    set(BLACK, c - 1, c);
 }
 
 /*
  * Destructor for the board.
  */
-Board::~Board() {
+template <int N>
+BasicBoard<N>::~BasicBoard() {
 }
 
 /*
  * Returns a copy of this board.
  */
-Board *Board::copy() {
-    Board *newBoard = new Board();
+template <int N>
+BasicBoard<N> *BasicBoard<N>::copy() {
+    BasicBoard *newBoard = new BasicBoard();
     newBoard->black = black;
     newBoard->taken = taken;
     return newBoard;
 }
 
-bool Board::occupied(int x, int y) {
-    return taken[x + 8*y];
+template <int N>
+bool BasicBoard<N>::occupied(int x, int y) {
+    return (taken & BoardGeometry<N>::square(x, y)) != 0;
 }
 
-bool Board::get(Side side, int x, int y) {
-    return occupied(x, y) && (black[x + 8*y] == (side == BLACK));
+template <int N>
+bool BasicBoard<N>::get(Side side, int x, int y) {
+    return (discs(side) & BoardGeometry<N>::square(x, y)) != 0;
 }
 
-void Board::set(Side side, int x, int y) {
-    taken.set(x + 8*y);
-    black.set(x + 8*y, side == BLACK);
+template <int N>
+void BasicBoard<N>::set(Side side, int x, int y) {
+    Word bit = BoardGeometry<N>::square(x, y);
+    taken |= bit;
+    if (side == BLACK)
+        black |= bit;
+    else
+        black &= (Word) ~bit;
 }
 
-bool Board::onBoard(int x, int y) {
-    return(0 <= x && x < 8 && 0 <= y && y < 8);
+template <int N>
+bool BasicBoard<N>::onBoard(int x, int y) {
+    return(0 <= x && x < N && 0 <= y && y < N);
 }
 
 
@@ -50,215 +98,123 @@ bool Board::onBoard(int x, int y) {
  * Returns true if the game is finished; false otherwise. The game is finished
  * if neither side has a legal move.
  */
-bool Board::isDone() {
+template <int N>
+bool BasicBoard<N>::isDone() {
     return !(hasMoves(BLACK) || hasMoves(WHITE));
 }
 
 /*
  * Returns true if there are legal moves for the given side.
  */
-bool Board::hasMoves(Side side) {
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            Move move(i, j);
-            if (checkMove(&move, side)) return true;
-        }
-    }
-    return false;
+template <int N>
+bool BasicBoard<N>::hasMoves(Side side) {
+    return legalMoves(side) != 0;
 }
 
 /*
  * Returns true if a move is legal for the given side; false otherwise.
  */
-bool Board::checkMove(Move *m, Side side) {
+template <int N>
+bool BasicBoard<N>::checkMove(Move *m, Side side) {
     // Passing is only legal if you have no moves.
     if (m == nullptr) return !hasMoves(side);
 
     int X = m->getX();
     int Y = m->getY();
 
-    // Make sure the square hasn't already been taken.
-    if (occupied(X, Y)) return false;
+    // Make sure the square is on the board and hasn't already been taken.
+    if (!onBoard(X, Y) || occupied(X, Y)) return false;
 
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            // Is there a capture in that direction?
-            int x = X + dx;
-            int y = Y + dy;
-            if (onBoard(x, y) && get(other, x, y)) {
-                do {
-                    x += dx;
-                    y += dy;
-                } while (onBoard(x, y) && get(other, x, y));
-
-                if (onBoard(x, y) && get(side, x, y)) return true;
-            }
-        }
-    }
-    return false;
+    return flips(X + N * Y, side) != 0;
 }
 
 /*
  * Modifies the board to reflect the specified move.
  */
-void Board::doMove(Move *m, Side side) {
+template <int N>
+void BasicBoard<N>::doMove(Move *m, Side side) {
     // A nullptr move means pass.
     if (m == nullptr) return;
 
     // Ignore if move is invalid.
     if (!checkMove(m, side)) return;
 
-    int X = m->getX();
-    int Y = m->getY();
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            int x = X;
-            int y = Y;
-            do {
-                x += dx;
-                y += dy;
-            } while (onBoard(x, y) && get(other, x, y));
-
-            if (onBoard(x, y) && get(side, x, y)) {
-                x = X;
-                y = Y;
-                x += dx;
-                y += dy;
-                while (onBoard(x, y) && get(other, x, y)) {
-                    set(side, x, y);
-                    x += dx;
-                    y += dy;
-                }
-            }
-        }
-    }
-    set(side, X, Y);
+    makeMove(m->getX() + N * m->getY(), side);
 }
 
 /*
  * Current count of given side's stones.
  */
-int Board::count(Side side) {
+template <int N>
+int BasicBoard<N>::count(Side side) {
     return (side == BLACK) ? countBlack() : countWhite();
 }
 
 /*
  * Current count of black stones.
  */
-int Board::countBlack() {
-    return black.count();
+template <int N>
+int BasicBoard<N>::countBlack() {
+    return popCount(black);
 }
 
 /*
  * Current count of white stones.
  */
-int Board::countWhite() {
-    return taken.count() - black.count();
+template <int N>
+int BasicBoard<N>::countWhite() {
+    return popCount(taken) - popCount(black);
 }
 
 /*
  * Current count of corner stones for given side
  */
-int Board::fourCorners(Side side)
+template <int N>
+int BasicBoard<N>::fourCorners(Side side)
 {
-    int count = 0;
-
-    for (int i = 0; i < 2; i++)
-    {
-        for (int j = 0; j < 2; j++)
-        {
-            if (get(side, (i*7), (j*7)))
-                count += 1;
-        }
-    }
-    return count;
+    typedef BoardGeometry<N> G;
+    const Word corners = G::square(0, 0) | G::square(N - 1, 0) |
+                         G::square(0, N - 1) | G::square(N - 1, N - 1);
+    return popCount(discs(side) & corners);
 }
 
-/*
- * Count of potential corner stones for given side
- */
-
 /*
  * Current count of stones adjacent to corner for given side
  */
-int Board::cornerCloseness(Side side)
+template <int N>
+int BasicBoard<N>::cornerCloseness(Side side)
 {
-    int count = 0;
-    for (int i = 0; i < 8; i+=7)
-    {
-        for (int j = 1; j < 7; j+=5)
-        {
-            if (get(side, i, j))
-                count += 1;
-        }
-    }
-
-    for (int i = 1; i < 7; i+=5)
-    {
-        for (int j = 0; j < 8; j+=7)
-        {
-            if (get (side, i, j))
-                count += 1;
-        }
-    }
-    return count;
+    typedef BoardGeometry<N> G;
+    const Word cSquares = G::square(0, 1) | G::square(0, N - 2) |
+                          G::square(N - 1, 1) | G::square(N - 1, N - 2) |
+                          G::square(1, 0) | G::square(N - 2, 0) |
+                          G::square(1, N - 1) | G::square(N - 2, N - 1);
+    return popCount(discs(side) & cSquares);
 }
 
 /*
  * Count of "frontier discs" for given side
  */
-int Board::frontierDiscs(Side side)
+template <int N>
+int BasicBoard<N>::frontierDiscs(Side side)
 {
-    int count = 0;
-
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            if (get(side, i, j))
-            {
-                for (int k = -1; k < 2; k++)
-                {
-                    for (int l = -1; l < 2; l++)
-                    {
-                        if (onBoard((i+k), (j+l)) && 
-                            !occupied((i+k), (j+l)))
-                        {
-                            count += 1;
-                            goto loop;
-                        }
-                    }
-                }
-            }
-            loop: ;
-        }
-    }
-    return count;
+    return popCount(discs(side) & BoardGeometry<N>::neighbours(empty()));
 }
 
 /*
  * Get vector of possible moves for given stone.
  */
-std::vector<Move *> Board::possibleMoves(Side side)
+template <int N>
+std::vector<Move *> BasicBoard<N>::possibleMoves(Side side)
 {
     std::vector<Move *> moves;
 
-    for (int i = 0; i < 8; i++)
+    // Square order (x + N*y) differs from the old x-major scan; callers
+    // get the same set of moves.
+    for (Word m = legalMoves(side); m != 0; m &= m - 1)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            Move *move = new Move(i, j);
-            if (checkMove(move, side))
-            {
-                moves.push_back(move);
-            }
-        }
+        int square = lowestSquare(m);
+        moves.push_back(new Move(square % N, square / N));
     }
     return moves;
 }
@@ -266,20 +222,21 @@ std::vector<Move *> Board::possibleMoves(Side side)
 /*
  * Get static weight of given board position as basic test of favorability.
  */
-double Board::getStaticWeight(Side side)
+template <int N>
+double BasicBoard<N>::getStaticWeight(Side side)
 {
     int aiScore = 0;
     int oppScore = 0;
 
-    for (int i = 0; i < 8; i++)
+    Word own = discs(side);
+    for (Word t = taken; t != 0; t &= t - 1)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            if (get(side, i, j))
-                aiScore += staticWeights[i][j];
-            else if (occupied(i, j))
-                oppScore += staticWeights[i][j];
-        }
+        int square = lowestSquare(t);
+        int weight = squareWeight<N>(square % N, square / N);
+        if (own & ((Word) 1 << square))
+            aiScore += weight;
+        else
+            oppScore += weight;
     }
     return (double) (aiScore - oppScore);
 }
@@ -287,7 +244,8 @@ double Board::getStaticWeight(Side side)
 /*
  * Get heuristic for current board state
  */
-double Board::getHeuristicValue(Side side)
+template <int N>
+double BasicBoard<N>::getHeuristicValue(Side side)
 {
     Side other = (side == BLACK) ? WHITE : BLACK;
 
@@ -297,8 +255,8 @@ double Board::getHeuristicValue(Side side)
     double coinVal = 100 * (aiCoins - oppCoins) / (aiCoins + oppCoins);
 
     // Calculate actual mobility
-    double aiMoves = (double) possibleMoves(side).size();
-    double oppMoves = (double) possibleMoves(other).size();
+    double aiMoves = (double) popCount(legalMoves(side));
+    double oppMoves = (double) popCount(legalMoves(other));
     double mobVal = 0;
     if ((aiMoves + oppMoves) != 0)
         mobVal = 100 * (aiMoves - oppMoves) / (aiMoves + oppMoves);
@@ -332,36 +290,43 @@ double Board::getHeuristicValue(Side side)
     return score;
 }
 
-int Board::getNaiveHeuristic(Move *move, Side side)
+template <int N>
+int BasicBoard<N>::getNaiveHeuristic(Move *move, Side side)
 {
     Side other;
-    Board *testBoard = copy();
+    BasicBoard testBoard = *this;
 
     if (side == BLACK)
         other = WHITE;
     else
         other = BLACK;
 
-    testBoard->doMove(move, side);
-    
-    int value = count(side) - count(other);
+    testBoard.doMove(move, side);
+
+    int value = testBoard.count(side) - testBoard.count(other);
 
     return value;
 }
 
 /*
- * Sets the board state given an 8x8 char array where 'w' indicates a white
+ * Sets the board state given an N x N char array where 'w' indicates a white
  * piece and 'b' indicates a black piece. Mainly for testing purposes.
  */
-void Board::setBoard(char data[]) {
-    taken.reset();
-    black.reset();
-    for (int i = 0; i < 64; i++) {
+template <int N>
+void BasicBoard<N>::setBoard(char data[]) {
+    taken = 0;
+    black = 0;
+    for (int i = 0; i < N * N; i++) {
         if (data[i] == 'b') {
-            taken.set(i);
-            black.set(i);
+            taken |= (Word) ((uint64_t) 1 << i);
+            black |= (Word) ((uint64_t) 1 << i);
         } if (data[i] == 'w') {
-            taken.set(i);
+            taken |= (Word) ((uint64_t) 1 << i);
         }
     }
 }
+
+// Board sizes the engine and tests are built for.
+template class BasicBoard<4>;
+template class BasicBoard<6>;
+template class BasicBoard<8>;
@@ -2,26 +2,132 @@
 #define __BOARD_H__
 
 #include <iostream>
-#include <bitset>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <type_traits>
 #include "common.hpp"
 using namespace std;
 
-class Board {
+/*
+ * Bitboard word for an N x N board: the narrowest unsigned type with a bit
+ * per square. Square (x, y) is bit x + N*y.
+ */
+template <int N>
+struct BoardWord {
+    static_assert(N >= 4 && N <= 8 && N % 2 == 0,
+                  "board size must be 4, 6 or 8");
+    typedef typename conditional<N * N <= 16, uint16_t,
+            typename conditional<N * N <= 32, uint32_t,
+                                 uint64_t>::type>::type type;
+};
+
+/*
+ * Compile-time masks and shifts for an N x N bitboard. Direction DIR moves
+ * every square one step towards (dx, dy) and drops squares that would
+ * wrap around an edge or fall off the board:
+ *
+ *   0: (+1, 0)   1: (-1, 0)   2: (0, +1)   3: (0, -1)
+ *   4: (+1, +1)  5: (-1, +1)  6: (+1, -1)  7: (-1, -1)
+ */
+template <int N>
+struct BoardGeometry {
+    typedef typename BoardWord<N>::type Word;
+
+    static constexpr Word full() {
+        return (Word) (~(uint64_t) 0 >> (64 - N * N));
+    }
+
+    static constexpr Word column(int x, int y = 0) {
+        return (y >= N) ? 0 :
+            (Word) (((uint64_t) 1 << (x + N * y)) | column(x, y + 1));
+    }
+
+    static constexpr Word square(int x, int y) {
+        return (Word) ((uint64_t) 1 << (x + N * y));
+    }
+
+    static constexpr Word corners() {
+        return square(0, 0) | square(N - 1, 0) | square(0, N - 1) |
+               square(N - 1, N - 1);
+    }
+
+    // Squares a step in +x / -x can land on without having wrapped.
+    static constexpr Word notWest() { return (Word) (full() & ~column(0)); }
+    static constexpr Word notEast() { return (Word) (full() & ~column(N - 1)); }
+
+    template <int DIR>
+    static Word shift(Word b) {
+        switch (DIR) {
+        case 0: return (Word) ((b << 1) & notWest());
+        case 1: return (Word) ((b >> 1) & notEast());
+        case 2: return (Word) ((b << N) & full());
+        case 3: return (Word) (b >> N);
+        case 4: return (Word) ((b << (N + 1)) & notWest());
+        case 5: return (Word) ((b << (N - 1)) & notEast());
+        case 6: return (Word) ((b >> (N - 1)) & notWest());
+        default: return (Word) ((b >> (N + 1)) & notEast());
+        }
+    }
+
+    // Empty squares from which own captures opp along DIR.
+    template <int DIR>
+    static Word movesInDirection(Word own, Word opp, Word empty) {
+        Word run = shift<DIR>(own) & opp;
+        for (int i = 0; i < N - 3; i++)
+            run |= shift<DIR>(run) & opp;
+        return shift<DIR>(run) & empty;
+    }
+
+    // Discs flipped along DIR by playing the single square in bit.
+    template <int DIR>
+    static Word flipsInDirection(Word bit, Word own, Word opp) {
+        Word line = 0;
+        Word b = shift<DIR>(bit);
+        while (b & opp) {
+            line |= b;
+            b = shift<DIR>(b);
+        }
+        return (b & own) ? line : 0;
+    }
+
+    static Word moves(Word own, Word opp) {
+        Word empty = (Word) (full() & ~(own | opp));
+        return movesInDirection<0>(own, opp, empty) |
+               movesInDirection<1>(own, opp, empty) |
+               movesInDirection<2>(own, opp, empty) |
+               movesInDirection<3>(own, opp, empty) |
+               movesInDirection<4>(own, opp, empty) |
+               movesInDirection<5>(own, opp, empty) |
+               movesInDirection<6>(own, opp, empty) |
+               movesInDirection<7>(own, opp, empty);
+    }
+
+    // Squares next to at least one square of b, in any direction.
+    static Word neighbours(Word b) {
+        return shift<0>(b) | shift<1>(b) | shift<2>(b) | shift<3>(b) |
+               shift<4>(b) | shift<5>(b) | shift<6>(b) | shift<7>(b);
+    }
+};
+
+/*
+ * Othello board of N x N squares, stored as two bitboards. All sizes share
+ * the same code; N is a compile-time constant so the masks and loop bounds
+ * fold away and the 8x8 board compiles to plain 64-bit shifts and masks.
+ * Board is the standard 8x8 game.
+ */
+template <int N>
+class BasicBoard {
+
+public:
+    typedef typename BoardWord<N>::type Word;
+
+    static const int SIZE = N;
+    static const int SQUARES = N * N;
 
 private:
-    bitset<64> black;
-    bitset<64> taken;
-
-    int staticWeights[8][8] = {{4, -3, 2, 2, 2, 2, -3, 4},
-                               {-3, -4, -1, -1, -1, -1, -4, -3},
-                               {2, -1, 1, 0, 0, 1, -1, 2},
-                               {2, -1, 0, 1, 1, 0, -1, 2},
-                               {2, -1, 0, 1, 1, 0, -1, 2},
-                               {2, -1, 1, 0, 0, 1, -1, 2},
-                               {-3, -4, -1, -1, -1, -1, -4, -3},
-                               {4, -3, 2, 2, 2, 2, -3, 4}};
+    Word black;
+    Word taken;
 
     bool occupied(int x, int y);
     bool get(Side side, int x, int y);
@@ -29,9 +135,9 @@ private:
     bool onBoard(int x, int y);
 
 public:
-    Board();
-    ~Board();
-    Board *copy();
+    BasicBoard();
+    ~BasicBoard();
+    BasicBoard *copy();
 
     bool isDone();
     bool hasMoves(Side side);
@@ -48,7 +154,132 @@ public:
     double getHeuristicValue(Side side);
     int getNaiveHeuristic(Move *m, Side side);
 
+    // Bitboard interface used by the search
+    Word discs(Side side);
+    Word empty();
+    Word legalMoves(Side side);
+    Word flips(int square, Side side);
+    void makeMove(int square, Side side);
+    void makeMove(int square, Side side, Word flipped);
+    int countEmpty();
+
     void setBoard(char data[]);
 };
 
+typedef BasicBoard<8> Board;
+
+/*
+ * Number of set bits in a bitboard word.
+ */
+inline int popCount(uint64_t word) {
+    return __builtin_popcountll(word);
+}
+
+/*
+ * Index of the lowest set bit; word must be nonzero.
+ */
+inline int lowestSquare(uint64_t word) {
+    return __builtin_ctzll(word);
+}
+
+template <int N>
+inline typename BasicBoard<N>::Word BasicBoard<N>::discs(Side side) {
+    return (side == BLACK) ? black : (Word) (taken & ~black);
+}
+
+template <int N>
+inline typename BasicBoard<N>::Word BasicBoard<N>::empty() {
+    return (Word) (BoardGeometry<N>::full() & ~taken);
+}
+
+/*
+ * Bitboard of the squares side can legally play.
+ */
+template <int N>
+inline typename BasicBoard<N>::Word BasicBoard<N>::legalMoves(Side side) {
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    return BoardGeometry<N>::moves(discs(side), discs(other));
+}
+
+/*
+ * 8x8 fast path: parallel-prefix (Kogge-Stone) fill, four fill steps per
+ * direction instead of six. Masking the opponent's discs to the inner
+ * columns stops horizontal and diagonal runs from wrapping.
+ */
+template <>
+inline uint64_t BasicBoard<8>::legalMoves(Side side) {
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    uint64_t own = discs(side);
+    uint64_t opp = discs(other);
+    uint64_t inner = opp & 0x7e7e7e7e7e7e7e7eULL;
+    uint64_t moves = 0;
+
+    const int shifts[4] = {1, 8, 9, 7};
+    for (int i = 0; i < 4; i++) {
+        int s = shifts[i];
+        uint64_t mask = (s == 8) ? opp : inner;
+        uint64_t pairs = mask & (mask << s);
+        uint64_t flood = mask & (own << s);
+        flood |= mask & (flood << s);
+        flood |= pairs & (flood << (2 * s));
+        flood |= pairs & (flood << (2 * s));
+        moves |= flood << s;
+
+        pairs = mask & (mask >> s);
+        flood = mask & (own >> s);
+        flood |= mask & (flood >> s);
+        flood |= pairs & (flood >> (2 * s));
+        flood |= pairs & (flood >> (2 * s));
+        moves |= flood >> s;
+    }
+    return moves & ~taken;
+}
+
+/*
+ * Discs that side would flip by playing square; zero if the move is illegal.
+ */
+template <int N>
+inline typename BasicBoard<N>::Word BasicBoard<N>::flips(int square, Side side) {
+    typedef BoardGeometry<N> G;
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word own = discs(side);
+    Word opp = discs(other);
+    Word bit = (Word) ((uint64_t) 1 << square);
+    return G::template flipsInDirection<0>(bit, own, opp) |
+           G::template flipsInDirection<1>(bit, own, opp) |
+           G::template flipsInDirection<2>(bit, own, opp) |
+           G::template flipsInDirection<3>(bit, own, opp) |
+           G::template flipsInDirection<4>(bit, own, opp) |
+           G::template flipsInDirection<5>(bit, own, opp) |
+           G::template flipsInDirection<6>(bit, own, opp) |
+           G::template flipsInDirection<7>(bit, own, opp);
+}
+
+/*
+ * Plays a legal move given by its square index. No legality check; the
+ * search only feeds it squares from legalMoves().
+ */
+template <int N>
+inline void BasicBoard<N>::makeMove(int square, Side side) {
+    makeMove(square, side, flips(square, side));
+}
+
+/*
+ * Same, with the discs it flips already known from flips().
+ */
+template <int N>
+inline void BasicBoard<N>::makeMove(int square, Side side, Word flipped) {
+    Word change = (Word) (flipped | ((uint64_t) 1 << square));
+    taken |= change;
+    if (side == BLACK)
+        black |= change;
+    else
+        black &= (Word) ~change;
+}
+
+template <int N>
+inline int BasicBoard<N>::countEmpty() {
+    return N * N - popCount(taken);
+}
+
 #endif
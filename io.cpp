@@ -0,0 +1,151 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "io.hpp"
+
+LineReader::LineReader(int fd) {
+    this->fd = fd;
+    start = 0;
+    end = 0;
+}
+
+/*
+ * Returns the next line with its newline (and any '\r') stripped, or nullptr
+ * at end of input. A final line without a newline is still returned. Lines
+ * longer than the buffer are truncated.
+ */
+char *LineReader::readLine() {
+    while (true) {
+        char *line = buffer + start;
+        char *newline = (char *) memchr(line, '\n', end - start);
+        if (newline != nullptr) {
+            *newline = '\0';
+            if (newline > line && newline[-1] == '\r')
+                newline[-1] = '\0';
+            start = newline + 1 - buffer;
+            return line;
+        }
+
+        // Slide the partial line to the front to make room for more input.
+        if (start > 0) {
+            memmove(buffer, buffer + start, end - start);
+            end -= start;
+            start = 0;
+        }
+
+        // Buffer is full without a newline; hand back what we have.
+        if (end == LINE_BUFFER_SIZE - 1) {
+            buffer[end] = '\0';
+            start = end = 0;
+            return buffer;
+        }
+
+        ssize_t n = read(fd, buffer + end, LINE_BUFFER_SIZE - 1 - end);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (end == 0)
+                return nullptr;
+            buffer[end] = '\0';
+            start = end = 0;
+            return buffer;
+        }
+        end += n;
+    }
+}
+
+/*
+ * Writes the whole buffer to fd, retrying on short writes. Returns false if
+ * the other end went away.
+ */
+bool writeAll(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+/*
+ * Parses an optionally signed decimal integer, skipping leading blanks, and
+ * advances *text past it. Returns false if there is no number.
+ */
+bool parseInt(const char **text, int *value) {
+    const char *p = *text;
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = (*p == '-');
+        p++;
+    }
+    if (*p < '0' || *p > '9')
+        return false;
+
+    long result = 0;
+    while (*p >= '0' && *p <= '9') {
+        if (result < 1000000000L)
+            result = result * 10 + (*p - '0');
+        p++;
+    }
+    *value = (int) (negative ? -result : result);
+    *text = p;
+    return true;
+}
+
+/*
+ * Returns the next blank-separated word (not NUL-terminated) and its length,
+ * advancing *text past it, or nullptr if the line is exhausted.
+ */
+const char *parseWord(const char **text, size_t *length) {
+    const char *p = *text;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '\0')
+        return nullptr;
+
+    const char *word = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t')
+        p++;
+    *length = p - word;
+    *text = p;
+    return word;
+}
+
+/*
+ * Writes the decimal form of value to out (no terminator) and returns the
+ * number of characters written. out needs room for 11 characters.
+ */
+size_t formatInt(char *out, int value) {
+    char digits[12];
+    size_t n = 0;
+    unsigned int v = (value < 0) ? -(unsigned int) value : value;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    size_t length = 0;
+    if (value < 0)
+        out[length++] = '-';
+    while (n > 0)
+        out[length++] = digits[--n];
+    return length;
+}
+
+/*
+ * Writes a move in protocol form, "x y" or "-1 -1" for a pass, to out (no
+ * terminator) and returns its length. out needs room for 23 characters.
+ */
+size_t formatMove(char *out, Move *move) {
+    size_t length = formatInt(out, (move != nullptr) ? move->x : -1);
+    out[length++] = ' ';
+    length += formatInt(out + length, (move != nullptr) ? move->y : -1);
+    return length;
+}
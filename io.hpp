@@ -0,0 +1,34 @@
+#ifndef __IO_H__
+#define __IO_H__
+
+#include <cstddef>
+#include "common.hpp"
+
+#define LINE_BUFFER_SIZE 4096
+
+/*
+ * Unbuffered line reader over a raw file descriptor. Lines are returned in
+ * place from a fixed buffer, so reading never allocates; a returned line is
+ * only valid until the next call to readLine().
+ */
+class LineReader {
+
+public:
+    LineReader(int fd);
+
+    char *readLine();
+
+private:
+    int fd;
+    char buffer[LINE_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+};
+
+bool writeAll(int fd, const char *data, size_t length);
+bool parseInt(const char **text, int *value);
+const char *parseWord(const char **text, size_t *length);
+size_t formatInt(char *out, int value);
+size_t formatMove(char *out, Move *move);
+
+#endif
@@ -0,0 +1,336 @@
+#include <cmath>
+#include <new>
+#include <thread>
+#include <vector>
+#include "mcts.hpp"
+using namespace std;
+
+// Node states; children may only be read once a node is EXPANDED
+#define LEAF 0
+#define EXPANDING 1
+#define EXPANDED 2
+
+// Visits a leaf needs before it gets children of its own, so the arena
+// isn't spent on nodes that are only ever played through once
+#define EXPAND_VISITS 2
+
+// Exploration constant of the UCT formula, for values in [0, 1]
+#define UCT_C 1.0
+
+// One playout move in this many ignores the corner / X-square bias
+#define UNBIASED_ONE_IN 8
+
+// Playouts per move when there is no deadline
+#define DEFAULT_PLAYOUTS 20000
+
+template <int N>
+static constexpr typename BasicBoard<N>::Word xSquares() {
+    return BoardGeometry<N>::square(1, 1) | BoardGeometry<N>::square(N - 2, 1) |
+           BoardGeometry<N>::square(1, N - 2) |
+           BoardGeometry<N>::square(N - 2, N - 2);
+}
+
+/*
+ * xorshift64* generator; each thread keeps its own state.
+ */
+static inline uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+/*
+ * Uniformly random integer in [0, n).
+ */
+static inline int randomBelow(uint64_t *state, int n) {
+    return (int) (((nextRandom(state) >> 32) * (uint64_t) n) >> 32);
+}
+
+static void initNode(MctsNode *node, int square) {
+    node->visits.store(0);
+    node->score.store(0);
+    node->virtualLoss.store(0);
+    node->firstChild.store(-1);
+    node->state.store(LEAF);
+    node->square = (int8_t) square;
+    node->childCount = 0;
+}
+
+/*
+ * The arena holds up to capacity nodes; see resize.
+ */
+template <int N>
+Mcts<N>::Mcts(int capacity) {
+    this->capacity = 0;
+    nodes = nullptr;
+    resize(capacity);
+    next.store(0);
+    fixedPlayouts = DEFAULT_PLAYOUTS;
+    playouts.store(0);
+    maxDepth.store(0);
+    nodesUsed = 0;
+}
+
+template <int N>
+Mcts<N>::~Mcts() {
+    delete[] nodes;
+}
+
+/*
+ * Replaces the arena with one of capacity nodes, settling for a smaller one
+ * if memory is short, or none at all. Returns the capacity it got, so the
+ * caller can account for what was actually allocated.
+ */
+template <int N>
+int Mcts<N>::resize(int capacity) {
+    delete[] nodes;
+    nodes = nullptr;
+    this->capacity = 0;
+
+    while (nodes == nullptr && capacity > N * N) {
+        nodes = new (std::nothrow) MctsNode[capacity];
+        if (nodes == nullptr)
+            capacity /= 2;
+    }
+    if (nodes != nullptr)
+        this->capacity = capacity;
+    return this->capacity;
+}
+
+/*
+ * Gives node its children: one per legal move, or a single pass if side
+ * has to pass, or none if the game is over. Returns false if another
+ * thread got there first or the arena is full.
+ */
+template <int N>
+bool Mcts<N>::expand(MctsNode *node, BoardType *board, Side side) {
+    typedef typename BoardType::Word Word;
+
+    if (next.load() + N * N > capacity)
+        return false;
+
+    int expected = LEAF;
+    if (!node->state.compare_exchange_strong(expected, EXPANDING))
+        return false;
+
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word moves = board->legalMoves(side);
+    int count = popCount(moves);
+    bool pass = (count == 0) && board->legalMoves(other) != 0;
+    if (pass)
+        count = 1;
+
+    int first = next.fetch_add(count);
+    if (first + count > capacity) {
+        node->state.store(LEAF);
+        return false;
+    }
+
+    if (pass) {
+        initNode(&nodes[first], -1);
+    } else {
+        for (int i = 0; moves != 0; moves &= moves - 1, i++)
+            initNode(&nodes[first + i], lowestSquare(moves));
+    }
+
+    node->childCount = (uint8_t) count;
+    node->firstChild.store(first);
+    node->state.store(EXPANDED);
+    return true;
+}
+
+/*
+ * UCT choice among the children of an expanded node. Threads below a child
+ * count as extra visits that were all lost (virtual loss).
+ */
+template <int N>
+int Mcts<N>::select(MctsNode *node) {
+    int first = node->firstChild.load();
+    int parentVisits = node->visits.load() + node->virtualLoss.load();
+    double logParent = log((double) max(parentVisits, 1));
+
+    int best = first;
+    double bestValue = -1;
+    for (int i = first; i < first + node->childCount; i++) {
+        MctsNode *child = &nodes[i];
+        int n = child->visits.load() + child->virtualLoss.load();
+        if (n == 0)
+            return i;
+
+        double value = child->score.load() / (2.0 * n) +
+                       UCT_C * sqrt(logParent / n);
+        if (value > bestValue) {
+            bestValue = value;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Plays random moves to the end of the game. Returns +1 if black wins,
+ * -1 if white wins and 0 for a draw.
+ */
+template <int N>
+int Mcts<N>::playout(BoardType board, Side side, uint64_t *rng) {
+    typedef typename BoardType::Word Word;
+
+    while (true) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        Word moves = board.legalMoves(side);
+        if (moves == 0) {
+            if (board.legalMoves(other) == 0)
+                break;
+            side = other;
+            continue;
+        }
+
+        // Take corners when offered and stay off X-squares if possible
+        Word choices = moves;
+        if (randomBelow(rng, UNBIASED_ONE_IN) != 0) {
+            if (moves & BoardGeometry<N>::corners())
+                choices = moves & BoardGeometry<N>::corners();
+            else if (moves & ~xSquares<N>())
+                choices = moves & ~xSquares<N>();
+        }
+
+        for (int pick = randomBelow(rng, popCount(choices)); pick > 0; pick--)
+            choices &= choices - 1;
+        board.makeMove(lowestSquare(choices), side);
+        side = other;
+    }
+
+    int diff = board.countBlack() - board.countWhite();
+    return (diff > 0) - (diff < 0);
+}
+
+/*
+ * One selection / expansion / playout / backup pass from the root.
+ */
+template <int N>
+void Mcts<N>::iterate(uint64_t *rng) {
+    MctsNode *path[2 * N * N + 2];
+    Side movers[2 * N * N + 2];
+    int length = 0;
+
+    BoardType board = root;
+    Side side = rootSide;
+    MctsNode *node = &nodes[0];
+    path[length] = node;
+    movers[length++] = (side == BLACK) ? WHITE : BLACK;
+    node->virtualLoss++;
+
+    while (true) {
+        int state = node->state.load();
+        if (state == LEAF && (node == &nodes[0] ||
+                              node->visits.load() >= EXPAND_VISITS))
+            state = expand(node, &board, side) ? EXPANDED : LEAF;
+
+        if (state != EXPANDED || node->childCount == 0)
+            break;
+
+        node = &nodes[select(node)];
+        if (node->square >= 0)
+            board.makeMove(node->square, side);
+        path[length] = node;
+        movers[length++] = side;
+        node->virtualLoss++;
+        side = (side == BLACK) ? WHITE : BLACK;
+
+        // Play out from freshly expanded children right away
+        if (node->visits.load() == 0)
+            break;
+    }
+
+    int winner = playout(board, side, rng);
+
+    for (int i = 0; i < length; i++) {
+        int points = 1 + ((movers[i] == BLACK) ? winner : -winner);
+        path[i]->score += points;
+        path[i]->visits++;
+        path[i]->virtualLoss--;
+    }
+
+    int deepest = maxDepth.load();
+    while (length - 1 > deepest &&
+           !maxDepth.compare_exchange_weak(deepest, length - 1))
+        ;
+}
+
+/*
+ * Runs iterations until the deadline (or fixedPlayouts without one).
+ */
+template <int N>
+void Mcts<N>::worker(uint64_t seed) {
+    uint64_t rng = seed | 1;
+    while (true) {
+        if (deadline.limited()) {
+            if (deadline.passed())
+                break;
+        } else if (playouts.load() >= fixedPlayouts) {
+            break;
+        }
+
+        iterate(&rng);
+        playouts++;
+    }
+}
+
+/*
+ * Returns the most visited move for side on board, or -1 if side has to
+ * pass. Builds a fresh tree in the arena on every call.
+ */
+template <int N>
+int Mcts<N>::findMove(BoardType *board, Side side, int threads) {
+    typedef typename BoardType::Word Word;
+
+    playouts.store(0);
+    maxDepth.store(0);
+    nodesUsed = 0;
+
+    Word moves = board->legalMoves(side);
+    if (moves == 0)
+        return -1;
+    if ((moves & (moves - 1)) == 0)
+        return lowestSquare(moves);
+
+    // Without an arena, play the first legal move
+    if (nodes == nullptr)
+        return lowestSquare(moves);
+
+    root = *board;
+    rootSide = side;
+    initNode(&nodes[0], -1);
+    next.store(1);
+
+    uint64_t seed = (uint64_t) Clock::now().time_since_epoch().count();
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads; i++)
+        helpers.push_back(std::thread(&Mcts::worker, this,
+                                      seed + i * 0x9e3779b97f4a7c15ULL));
+    worker(seed);
+    for (unsigned int i = 0; i < helpers.size(); i++)
+        helpers[i].join();
+
+    nodesUsed = min(next.load(), capacity);
+
+    // Root is always expanded first unless the arena is too small
+    if (nodes[0].state.load() != EXPANDED)
+        return lowestSquare(moves);
+
+    int first = nodes[0].firstChild.load();
+    int best = first;
+    for (int i = first; i < first + nodes[0].childCount; i++) {
+        if (nodes[i].visits.load() > nodes[best].visits.load())
+            best = i;
+    }
+    return nodes[best].square;
+}
+
+// Board sizes the engine and tests are built for.
+template class Mcts<4>;
+template class Mcts<6>;
+template class Mcts<8>;
@@ -0,0 +1,70 @@
+#ifndef __MCTS_H__
+#define __MCTS_H__
+
+#include <atomic>
+#include <cstdint>
+#include "board.hpp"
+#include "timer.hpp"
+
+/*
+ * One node of the search tree. Nodes live in a fixed arena and are never
+ * freed individually; children of a node are contiguous in the arena.
+ * Statistics are from the point of view of the side that played the move
+ * leading to the node.
+ */
+struct MctsNode {
+    std::atomic<int> visits;
+    std::atomic<int> score;         // 2 per win, 1 per draw
+    std::atomic<int> virtualLoss;   // threads currently below this node
+    std::atomic<int> firstChild;
+    std::atomic<int> state;         // LEAF, EXPANDING or EXPANDED
+    int8_t square;                  // move leading here; -1 for a pass
+    uint8_t childCount;
+};
+
+/*
+ * Monte Carlo Tree Search (UCT) for an N x N board. Playouts are random,
+ * nudged towards corners and away from X-squares, and run on bitboards
+ * without allocating. Several threads can share one tree; each thread
+ * marks the path it is working on with a virtual loss so the others
+ * spread out over different branches.
+ */
+template <int N>
+class Mcts {
+
+public:
+    typedef BasicBoard<N> BoardType;
+
+    Mcts(int capacity);
+    ~Mcts();
+
+    int findMove(BoardType *board, Side side, int threads);
+    int resize(int capacity);
+
+    // Time budget of findMove; without a limit it runs fixedPlayouts
+    Deadline deadline;
+
+    // Playouts per move when there is no deadline
+    int fixedPlayouts;
+
+    // Statistics of the last findMove
+    std::atomic<long long> playouts;
+    std::atomic<int> maxDepth;
+    int nodesUsed;
+
+private:
+    void worker(uint64_t seed);
+    void iterate(uint64_t *rng);
+    bool expand(MctsNode *node, BoardType *board, Side side);
+    int select(MctsNode *node);
+    int playout(BoardType board, Side side, uint64_t *rng);
+
+    MctsNode *nodes;
+    int capacity;
+    std::atomic<int> next;
+
+    BoardType root;
+    Side rootSide;
+};
+
+#endif
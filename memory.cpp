@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "memory.hpp"
+using namespace std;
+
+// Kept out of the budget for code, heap, thread stacks and the like
+#define MIN_HEADROOM_BYTES ((size_t) 64 << 20)
+// Share of the limit at which table owners are asked to shrink
+#define PRESSURE_PERCENT 90
+
+/*
+ * Reads the limits once. Without any limit, physical memory is the limit.
+ */
+MemoryManager::MemoryManager() {
+    limit = (size_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    virtualLimited = false;
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        rl.rlim_cur < limit) {
+        limit = rl.rlim_cur;
+        virtualLimited = true;
+    }
+    if (getrlimit(RLIMIT_RSS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        rl.rlim_cur < limit) {
+        limit = rl.rlim_cur;
+        virtualLimited = false;
+    }
+
+    // The address space limit also counts what is mapped before we start.
+    size_t used = virtualLimited ? virtualBytes() : residentBytes();
+    size_t headroom = max(limit / 4, MIN_HEADROOM_BYTES);
+    budget = (limit > used + headroom) ? limit - used - headroom : 0;
+    granted = 0;
+}
+
+MemoryManager &MemoryManager::instance() {
+    static MemoryManager manager;
+    return manager;
+}
+
+/*
+ * Grants up to wanted bytes from what is left of the budget. Returns 0 if
+ * not even minimum is left, in which case the caller should do without.
+ */
+size_t MemoryManager::reserve(size_t wanted, size_t minimum) {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t left = budget - granted;
+    size_t bytes = min(wanted, left);
+    if (bytes < minimum)
+        return 0;
+    granted += bytes;
+    return bytes;
+}
+
+void MemoryManager::release(size_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    granted -= min(bytes, granted);
+}
+
+/*
+ * True once the process uses more than PRESSURE_PERCENT of its limit,
+ * counting address space if that is what is limited.
+ */
+bool MemoryManager::underPressure() {
+    size_t used = virtualLimited ? virtualBytes() : residentBytes();
+    return used > limit / 100 * PRESSURE_PERCENT;
+}
+
+/*
+ * Reads the current size and resident set of the process from
+ * /proc/self/statm (in pages); returns false where that isn't available.
+ */
+static bool readStatm(size_t *size, size_t *resident) {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == nullptr)
+        return false;
+    unsigned long pages, residentPages;
+    bool ok = fscanf(file, "%lu %lu", &pages, &residentPages) == 2;
+    fclose(file);
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    *size = pages * pageSize;
+    *resident = residentPages * pageSize;
+    return ok;
+}
+
+size_t MemoryManager::residentBytes() {
+    size_t size, resident;
+    return readStatm(&size, &resident) ? resident : 0;
+}
+
+size_t MemoryManager::virtualBytes() {
+    size_t size, resident;
+    return readStatm(&size, &resident) ? size : 0;
+}
+
+/*
+ * High-water mark of the resident set over the life of the process.
+ */
+size_t MemoryManager::peakResidentBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (size_t) usage.ru_maxrss * 1024;
+}
+
+size_t MemoryManager::limitBytes() {
+    return limit;
+}
+
+size_t MemoryManager::budgetBytes() {
+    return budget;
+}
+
+size_t MemoryManager::grantedBytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return granted;
+}
+
+/*
+ * Summary of one game's memory use on stderr, next to the process-wide
+ * peak and budget. In server mode the resident figures are for the whole
+ * process while the game was being played.
+ */
+void printMemoryReport(const char *label, size_t peak, size_t steady,
+                       size_t tables, int shrinks) {
+    MemoryManager &memory = MemoryManager::instance();
+    const double MB = 1 << 20;
+    fprintf(stderr, "%s: peak %.1f MB, steady %.1f MB, tables %.1f MB, "
+            "shrunk %d times; process peak %.1f MB, budget %.1f of %.1f MB, "
+            "limit %.1f MB\n", label, peak / MB, steady / MB, tables / MB,
+            shrinks, memory.peakResidentBytes() / MB,
+            memory.grantedBytes() / MB, memory.budgetBytes() / MB,
+            memory.limitBytes() / MB);
+}
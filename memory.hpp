@@ -0,0 +1,46 @@
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <cstddef>
+#include <mutex>
+
+/*
+ * Process-wide memory budget. At startup it reads the address space and
+ * resident set limits (the Java harness runs us under ulimit -m/-v) and
+ * keeps a budget for the large engine tables: transposition tables, MCTS
+ * arenas, trace buffers and evaluation weights. Each owner asks for what
+ * it would like with reserve() and gets what is left, and gives it back
+ * with release(). Owners shrink their tables when underPressure() says
+ * the process is getting close to its limit.
+ */
+class MemoryManager {
+
+public:
+    static MemoryManager &instance();
+
+    size_t reserve(size_t wanted, size_t minimum);
+    void release(size_t bytes);
+
+    bool underPressure();
+    size_t residentBytes();
+    size_t virtualBytes();
+    size_t peakResidentBytes();
+
+    size_t limitBytes();
+    size_t budgetBytes();
+    size_t grantedBytes();
+
+private:
+    MemoryManager();
+
+    std::mutex lock;
+    size_t limit;
+    bool virtualLimited;
+    size_t budget;
+    size_t granted;
+};
+
+void printMemoryReport(const char *label, size_t peak, size_t steady,
+                       size_t tables, int shrinks);
+
+#endif
@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "nnue.hpp"
+using namespace std;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NNUE_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Reads a weight file written by save(). Returns false if it can't be read
+ * or was made for a different network shape.
+ */
+bool NnueWeights::load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    char magic[4];
+    int32_t header[5];
+    bool ok = fread(magic, 4, 1, file) == 1 &&
+              fread(header, sizeof(header), 1, file) == 1 &&
+              !memcmp(magic, NNUE_MAGIC, 4) && header[0] == NNUE_VERSION &&
+              header[1] == NNUE_INPUTS && header[2] == NNUE_HIDDEN &&
+              header[3] == NNUE_L2 && header[4] == NNUE_L3;
+
+    ok = ok && fread(hiddenBias, sizeof(hiddenBias), 1, file) == 1 &&
+         fread(hidden, sizeof(hidden), 1, file) == 1 &&
+         fread(l2Bias, sizeof(l2Bias), 1, file) == 1 &&
+         fread(l2, sizeof(l2), 1, file) == 1 &&
+         fread(l3Bias, sizeof(l3Bias), 1, file) == 1 &&
+         fread(l3, sizeof(l3), 1, file) == 1 &&
+         fread(&outputBias, sizeof(outputBias), 1, file) == 1 &&
+         fread(output, sizeof(output), 1, file) == 1;
+    fclose(file);
+
+    if (ok)
+        prepare();
+    return ok;
+}
+
+bool NnueWeights::save(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    int32_t header[5] = {NNUE_VERSION, NNUE_INPUTS, NNUE_HIDDEN, NNUE_L2, NNUE_L3};
+    bool ok = fwrite(NNUE_MAGIC, 4, 1, file) == 1 &&
+              fwrite(header, sizeof(header), 1, file) == 1 &&
+              fwrite(hiddenBias, sizeof(hiddenBias), 1, file) == 1 &&
+              fwrite(hidden, sizeof(hidden), 1, file) == 1 &&
+              fwrite(l2Bias, sizeof(l2Bias), 1, file) == 1 &&
+              fwrite(l2, sizeof(l2), 1, file) == 1 &&
+              fwrite(l3Bias, sizeof(l3Bias), 1, file) == 1 &&
+              fwrite(l3, sizeof(l3), 1, file) == 1 &&
+              fwrite(&outputBias, sizeof(outputBias), 1, file) == 1 &&
+              fwrite(output, sizeof(output), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+/*
+ * Derives the tables the evaluator needs from the stored weights.
+ */
+void NnueWeights::prepare() {
+    for (int s = 0; s < 64; s++)
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+            flip[s][i] = (int16_t) (hidden[s][i] - hidden[64 + s][i]);
+}
+
+/*
+ * Allocates and loads weights from path; nullptr if that fails.
+ */
+NnueWeights *loadNnueWeights(const char *path) {
+    NnueWeights *weights = new NnueWeights();
+    if (!weights->load(path)) {
+        delete weights;
+        return nullptr;
+    }
+    return weights;
+}
+
+bool nnueHasAvx2() {
+#ifdef NNUE_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+/*
+ * Kernels. Each has a portable version and, on x86, an AVX2 version the
+ * evaluator switches to at run time. Both give identical results.
+ */
+
+// to = from + add + delta, or from + add - delta if negate
+static void updateScalar(int16_t *to, const int16_t *from, const int16_t *add,
+                         const int16_t *delta, bool negate) {
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        to[i] = (int16_t) (from[i] + add[i] + (negate ? -delta[i] : delta[i]));
+}
+
+// Clips both halves of the accumulator, side to move first, to [0, 127]
+static void transformScalar(uint8_t *out, const int16_t *own, const int16_t *opp) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        out[i] = (uint8_t) min(max((int) own[i], 0), NNUE_ACTIVATION_MAX);
+        out[NNUE_HIDDEN + i] = (uint8_t) min(max((int) opp[i], 0),
+                                             NNUE_ACTIVATION_MAX);
+    }
+}
+
+// Dot products of in with each row of weights, before bias and shift
+static void denseScalar(int32_t *out, const uint8_t *in, const int8_t *weights,
+                        int inputs, int outputs) {
+    for (int j = 0; j < outputs; j++) {
+        int32_t sum = 0;
+        for (int i = 0; i < inputs; i++)
+            sum += in[i] * weights[j * inputs + i];
+        out[j] = sum;
+    }
+}
+
+#ifdef NNUE_X86
+__attribute__((target("avx2")))
+static void updateAvx2(int16_t *to, const int16_t *from, const int16_t *add,
+                       const int16_t *delta, bool negate) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i f = _mm256_loadu_si256((const __m256i *) (from + i));
+        __m256i a = _mm256_loadu_si256((const __m256i *) (add + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (delta + i));
+        __m256i sum = _mm256_add_epi16(f, a);
+        sum = negate ? _mm256_sub_epi16(sum, d) : _mm256_add_epi16(sum, d);
+        _mm256_storeu_si256((__m256i *) (to + i), sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void transformAvx2(uint8_t *out, const int16_t *own, const int16_t *opp) {
+    const int16_t *halves[2] = {own, opp};
+    for (int h = 0; h < 2; h++) {
+        for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (halves[h] + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (halves[h] + i + 16));
+            // Saturates to [-128, 127] but interleaves the 128-bit lanes
+            __m256i packed = _mm256_packs_epi16(a, b);
+            packed = _mm256_max_epi8(packed, _mm256_setzero_si256());
+            packed = _mm256_permute4x64_epi64(packed, 0xd8);
+            _mm256_storeu_si256((__m256i *) (out + h * NNUE_HIDDEN + i), packed);
+        }
+    }
+}
+
+// inputs must be a multiple of 32 and outputs of 4; four rows are summed
+// at a time so their horizontal adds can be shared
+__attribute__((target("avx2")))
+static void denseAvx2(int32_t *out, const uint8_t *in, const int8_t *weights,
+                      int inputs, int outputs) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int j = 0; j < outputs; j += 4) {
+        __m256i sums[4];
+        for (int k = 0; k < 4; k++)
+            sums[k] = _mm256_setzero_si256();
+        for (int i = 0; i < inputs; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *) (in + i));
+            for (int k = 0; k < 4; k++) {
+                const int8_t *row = weights + (j + k) * inputs + i;
+                __m256i w = _mm256_loadu_si256((const __m256i *) row);
+                // u8 * i8 pairs fit in int16 since activations are at most 127
+                __m256i products = _mm256_maddubs_epi16(x, w);
+                sums[k] = _mm256_add_epi32(sums[k],
+                                           _mm256_madd_epi16(products, ones));
+            }
+        }
+        __m256i pairs = _mm256_hadd_epi32(_mm256_hadd_epi32(sums[0], sums[1]),
+                                          _mm256_hadd_epi32(sums[2], sums[3]));
+        __m128i total = _mm_add_epi32(_mm256_castsi256_si128(pairs),
+                                      _mm256_extracti128_si256(pairs, 1));
+        _mm_storeu_si128((__m128i *) (out + j), total);
+    }
+}
+#endif
+
+// Adds bias, scales back to activation units and clips to [0, 127]
+static void activate(uint8_t *out, const int32_t *sums, const int32_t *bias,
+                     int outputs) {
+    for (int j = 0; j < outputs; j++) {
+        int32_t value = (sums[j] + bias[j]) >> NNUE_WEIGHT_SHIFT;
+        out[j] = (uint8_t) min(max(value, 0), NNUE_ACTIVATION_MAX);
+    }
+}
+
+NnueEvaluator::NnueEvaluator(const NnueWeights *weights) {
+    this->weights = weights;
+    simd = nnueHasAvx2();
+    top = 0;
+}
+
+/*
+ * Computes the accumulator of a root position from scratch and empties the
+ * stack.
+ */
+void NnueEvaluator::refresh(uint64_t black, uint64_t white) {
+    top = 0;
+    NnueAccumulator *acc = &stack[0];
+    for (int side = WHITE; side <= BLACK; side++) {
+        uint64_t own = (side == BLACK) ? black : white;
+        uint64_t opp = (side == BLACK) ? white : black;
+        int16_t *values = acc->values[side];
+        memcpy(values, weights->hiddenBias, sizeof(weights->hiddenBias));
+        for (; own != 0; own &= own - 1) {
+            const int16_t *row = weights->hidden[__builtin_ctzll(own)];
+            for (int i = 0; i < NNUE_HIDDEN; i++)
+                values[i] += row[i];
+        }
+        for (; opp != 0; opp &= opp - 1) {
+            const int16_t *row = weights->hidden[64 + __builtin_ctzll(opp)];
+            for (int i = 0; i < NNUE_HIDDEN; i++)
+                values[i] += row[i];
+        }
+    }
+}
+
+/*
+ * Pushes the accumulator after side plays square and flips the discs in
+ * flipped. For the mover the new disc is its own and each flipped disc
+ * turns from opponent's to own; for the other side the reverse.
+ */
+void NnueEvaluator::push(int square, uint64_t flipped, Side side) {
+    NnueAccumulator *from = &stack[top];
+    NnueAccumulator *to = &stack[++top];
+    Side other = (side == BLACK) ? WHITE : BLACK;
+
+    int16_t delta[NNUE_HIDDEN] = {0};
+    for (; flipped != 0; flipped &= flipped - 1) {
+        const int16_t *row = weights->flip[__builtin_ctzll(flipped)];
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+            delta[i] += row[i];
+    }
+
+#ifdef NNUE_X86
+    if (simd) {
+        updateAvx2(to->values[side], from->values[side], weights->hidden[square],
+                   delta, false);
+        updateAvx2(to->values[other], from->values[other],
+                   weights->hidden[64 + square], delta, true);
+        return;
+    }
+#endif
+    updateScalar(to->values[side], from->values[side], weights->hidden[square],
+                 delta, false);
+    updateScalar(to->values[other], from->values[other],
+                 weights->hidden[64 + square], delta, true);
+}
+
+void NnueEvaluator::pop() {
+    top--;
+}
+
+/*
+ * Expected final disc difference for side, the side to move, in the
+ * position on top of the stack.
+ */
+double NnueEvaluator::evaluate(Side side) {
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    const NnueAccumulator *acc = &stack[top];
+
+    uint8_t input[2 * NNUE_HIDDEN];
+    uint8_t l2[NNUE_L2], l3[NNUE_L3];
+    int32_t sums[NNUE_L2];
+    static_assert(NNUE_L3 <= NNUE_L2, "sums must hold either layer");
+
+#ifdef NNUE_X86
+    if (simd) {
+        transformAvx2(input, acc->values[side], acc->values[other]);
+        denseAvx2(sums, input, &weights->l2[0][0], 2 * NNUE_HIDDEN, NNUE_L2);
+        activate(l2, sums, weights->l2Bias, NNUE_L2);
+        denseAvx2(sums, l2, &weights->l3[0][0], NNUE_L2, NNUE_L3);
+        activate(l3, sums, weights->l3Bias, NNUE_L3);
+    } else
+#endif
+    {
+        transformScalar(input, acc->values[side], acc->values[other]);
+        denseScalar(sums, input, &weights->l2[0][0], 2 * NNUE_HIDDEN, NNUE_L2);
+        activate(l2, sums, weights->l2Bias, NNUE_L2);
+        denseScalar(sums, l2, &weights->l3[0][0], NNUE_L2, NNUE_L3);
+        activate(l3, sums, weights->l3Bias, NNUE_L3);
+    }
+
+    int32_t out = weights->outputBias;
+    for (int i = 0; i < NNUE_L3; i++)
+        out += l3[i] * weights->output[i];
+
+    return out * NNUE_OUTPUT_DISCS /
+        (NNUE_ACTIVATION_MAX << NNUE_WEIGHT_SHIFT);
+}
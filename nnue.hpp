@@ -0,0 +1,98 @@
+#ifndef __NNUE_H__
+#define __NNUE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include "common.hpp"
+
+/*
+ * Small quantized neural evaluator for the 8x8 board, in the style of NNUE.
+ *
+ * The first layer sees 128 inputs per perspective, "own disc on square s"
+ * and "opponent disc on square s", and keeps its sums for both sides in an
+ * accumulator that moves incrementally update from the flip mask. The side
+ * to move's half and the other half are clipped to [0, 127], then run
+ * through two int8 layers of NNUE_L2 units and a linear output, which is
+ * the expected final disc difference for the side to move.
+ *
+ * Fixed point: the accumulator and first layer weights are in units of
+ * 1/127, the int8 weights in units of 1/64 (NNUE_WEIGHT_SHIFT), and layer
+ * biases in units of 1/(127 * 64).
+ */
+
+#define NNUE_INPUTS 128
+#define NNUE_HIDDEN 64
+#define NNUE_L2 32
+#define NNUE_L3 32
+#define NNUE_WEIGHT_SHIFT 6
+#define NNUE_ACTIVATION_MAX 127
+// Network output of 1.0 is this many discs
+#define NNUE_OUTPUT_DISCS 64.0
+
+// Weight file; "DNUE", version, then the layers in NnueWeights order
+#define NNUE_MAGIC "DNUE"
+#define NNUE_VERSION 1
+
+// Weights are read once per process from here, or from the path in the
+// environment variable if it is set; see sharedNnueWeights. The shipped
+// desdemona.nnue is rebuilt exactly by "make nnuetrain && ./nnuetrain
+// desdemona.nnue"
+#define NNUE_PATH_ENV "DESDEMONA_NNUE"
+#define NNUE_DEFAULT_PATH "desdemona.nnue"
+
+// Moves an evaluator can have on its accumulator stack; a game has 60
+#define NNUE_MAX_PLY 64
+
+struct NnueWeights {
+    int16_t hiddenBias[NNUE_HIDDEN];
+    int16_t hidden[NNUE_INPUTS][NNUE_HIDDEN];
+    int32_t l2Bias[NNUE_L2];
+    int8_t l2[NNUE_L2][2 * NNUE_HIDDEN];
+    int32_t l3Bias[NNUE_L3];
+    int8_t l3[NNUE_L3][NNUE_L2];
+    int32_t outputBias;
+    int8_t output[NNUE_L3];
+
+    // hidden[own s] - hidden[opponent s], what a flip of s adds for the
+    // side that flips it; derived on load
+    int16_t flip[64][NNUE_HIDDEN];
+
+    bool load(const char *path);
+    bool save(const char *path);
+    void prepare();
+};
+
+/*
+ * First layer sums for both perspectives, indexed by Side.
+ */
+struct NnueAccumulator {
+    int16_t values[2][NNUE_HIDDEN];
+};
+
+/*
+ * Evaluates positions along one search path. refresh() sets up the root,
+ * then each move pushes an updated accumulator and its undo pops it.
+ */
+class NnueEvaluator {
+
+public:
+    NnueEvaluator(const NnueWeights *weights);
+
+    void refresh(uint64_t black, uint64_t white);
+    void push(int square, uint64_t flipped, Side side);
+    void pop();
+    double evaluate(Side side);
+
+    // Use the AVX2 kernels where the CPU has them; on by default if so
+    bool simd;
+
+private:
+    const NnueWeights *weights;
+    NnueAccumulator stack[NNUE_MAX_PLY + 1];
+    int top;
+};
+
+bool nnueHasAvx2();
+NnueWeights *loadNnueWeights(const char *path);
+
+#endif
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "board.hpp"
+#include "nnue.hpp"
+using namespace std;
+
+// Trains the neural evaluator (see nnue.hpp) and writes its weight file.
+//
+//   nnuetrain out [positions] [epochs]
+//
+// The defaults are what the shipped weights were trained with, so
+// "nnuetrain desdemona.nnue" rebuilds that file. Training is seeded and
+// single-threaded, and the result only depends on the compiler's floating
+// point.
+//
+// Positions come from games of corner-seeking random play. Each is labelled
+// with the average final disc difference of PLAYOUTS such games played on
+// from it, from the point of view of the side to move. The network is
+// trained in floating point on all eight symmetries of the board and then
+// quantized, with weights kept in the range the fixed-point layers can hold.
+
+#define PLAYOUTS 16
+#define BATCH 256
+#define LEARNING_RATE 0.001
+
+// Defaults the shipped desdemona.nnue was trained with
+#define DEFAULT_POSITIONS 500000
+#define DEFAULT_EPOCHS 8
+
+// Float weight limits that keep the quantized network in range
+#define HIDDEN_LIMIT 2.0
+#define DENSE_LIMIT (127.0 / (1 << NNUE_WEIGHT_SHIFT))
+
+static mt19937_64 rng(1);
+
+struct Sample {
+    uint64_t own;       // discs of the side to move
+    uint64_t opp;
+    float target;       // expected disc difference / NNUE_OUTPUT_DISCS
+};
+
+/*
+ * A playout move: a corner if there is one, otherwise anything but an
+ * X-square, except for one move in eight which is uniformly random.
+ */
+static int pickMove(uint64_t moves) {
+    const uint64_t corners = BoardGeometry<8>::corners();
+    const uint64_t xSquares = (1ULL << 9) | (1ULL << 14) | (1ULL << 49) |
+                              (1ULL << 54);
+    uint64_t choices = moves;
+    if (rng() % 8 != 0) {
+        if (moves & corners)
+            choices = moves & corners;
+        else if (moves & ~xSquares)
+            choices = moves & ~xSquares;
+    }
+    for (int pick = rng() % popCount(choices); pick > 0; pick--)
+        choices &= choices - 1;
+    return lowestSquare(choices);
+}
+
+/*
+ * Plays board out to the end and returns the disc difference for side.
+ */
+static int playout(Board board, Side side) {
+    Side start = side;
+    int passes = 0;
+    while (passes < 2) {
+        uint64_t moves = board.legalMoves(side);
+        if (moves == 0) {
+            passes++;
+        } else {
+            passes = 0;
+            board.makeMove(pickMove(moves), side);
+        }
+        side = (side == BLACK) ? WHITE : BLACK;
+    }
+    Side other = (start == BLACK) ? WHITE : BLACK;
+    return board.count(start) - board.count(other);
+}
+
+static void generate(int count, vector<Sample> *samples) {
+    while ((int) samples->size() < count) {
+        Board board;
+        Side side = BLACK;
+        int stop = 4 + rng() % 56;
+        for (int ply = 0; ply < stop && !board.isDone(); ply++) {
+            uint64_t moves = board.legalMoves(side);
+            if (moves != 0)
+                board.makeMove(pickMove(moves), side);
+            side = (side == BLACK) ? WHITE : BLACK;
+        }
+        if (board.isDone() || board.legalMoves(side) == 0)
+            continue;
+
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        double total = 0;
+        for (int p = 0; p < PLAYOUTS; p++)
+            total += playout(board, side);
+
+        Sample sample;
+        sample.own = board.discs(side);
+        sample.opp = board.discs(other);
+        sample.target = (float) (total / PLAYOUTS / NNUE_OUTPUT_DISCS);
+        samples->push_back(sample);
+    }
+}
+
+/*
+ * Square s under symmetry k of the 8x8 board (rotations and reflections).
+ */
+static int transform(int s, int k) {
+    int x = s % 8, y = s / 8;
+    if (k & 1) x = 7 - x;
+    if (k & 2) y = 7 - y;
+    if (k & 4) swap(x, y);
+    return x + 8 * y;
+}
+
+/*
+ * Floating point copy of the network with Adam state for every weight.
+ */
+struct Param {
+    vector<float> w, grad, m, v;
+    float limit;
+
+    void init(int n, float scale, float limit) {
+        w.resize(n);
+        grad.assign(n, 0);
+        m.assign(n, 0);
+        v.assign(n, 0);
+        this->limit = limit;
+        normal_distribution<float> normal(0, scale);
+        for (int i = 0; i < n; i++)
+            w[i] = normal(rng);
+    }
+
+    void step(int t) {
+        const float b1 = 0.9f, b2 = 0.999f, eps = 1e-8f;
+        float c1 = 1 - pow(b1, t), c2 = 1 - pow(b2, t);
+        for (size_t i = 0; i < w.size(); i++) {
+            m[i] = b1 * m[i] + (1 - b1) * grad[i];
+            v[i] = b2 * v[i] + (1 - b2) * grad[i] * grad[i];
+            w[i] -= LEARNING_RATE * (m[i] / c1) / (sqrt(v[i] / c2) + eps);
+            w[i] = max(-limit, min(limit, w[i]));
+            grad[i] = 0;
+        }
+    }
+};
+
+static const int H = NNUE_HIDDEN, X = 2 * NNUE_HIDDEN, L2 = NNUE_L2, L3 = NNUE_L3;
+
+struct Network {
+    Param hiddenBias, hidden, l2Bias, l2, l3Bias, l3, outputBias, output;
+
+    Network() {
+        hiddenBias.init(H, 0, HIDDEN_LIMIT);
+        hidden.init(NNUE_INPUTS * H, 0.1f, HIDDEN_LIMIT);
+        l2Bias.init(L2, 0, 1e6);
+        l2.init(L2 * X, sqrt(1.0f / X), DENSE_LIMIT);
+        l3Bias.init(L3, 0, 1e6);
+        l3.init(L3 * L2, sqrt(1.0f / L2), DENSE_LIMIT);
+        outputBias.init(1, 0, 1e6);
+        output.init(L3, sqrt(1.0f / L3), DENSE_LIMIT);
+    }
+
+    static float clip(float x) { return max(0.0f, min(1.0f, x)); }
+
+    /*
+     * Forward and, if learn, backward pass for one position seen through
+     * symmetry k. Returns the squared error.
+     */
+    float train(const Sample &s, int k, bool learn) {
+        int features[2][64];
+        int counts[2] = {0, 0};
+        for (int half = 0; half < 2; half++) {
+            for (uint64_t b = half ? s.opp : s.own; b != 0; b &= b - 1)
+                features[0][counts[0]++] = (half ? 64 : 0) +
+                    transform(lowestSquare(b), k);
+            for (uint64_t b = half ? s.own : s.opp; b != 0; b &= b - 1)
+                features[1][counts[1]++] = (half ? 64 : 0) +
+                    transform(lowestSquare(b), k);
+        }
+
+        float acc[X], x[X], h2[L2], h3[L3];
+        for (int p = 0; p < 2; p++) {
+            for (int i = 0; i < H; i++)
+                acc[p * H + i] = hiddenBias.w[i];
+            for (int f = 0; f < counts[p]; f++)
+                for (int i = 0; i < H; i++)
+                    acc[p * H + i] += hidden.w[features[p][f] * H + i];
+        }
+        for (int i = 0; i < X; i++)
+            x[i] = clip(acc[i]);
+        float z2[L2], z3[L3];
+        for (int j = 0; j < L2; j++) {
+            z2[j] = l2Bias.w[j];
+            for (int i = 0; i < X; i++)
+                z2[j] += l2.w[j * X + i] * x[i];
+            h2[j] = clip(z2[j]);
+        }
+        for (int j = 0; j < L3; j++) {
+            z3[j] = l3Bias.w[j];
+            for (int i = 0; i < L2; i++)
+                z3[j] += l3.w[j * L2 + i] * h2[i];
+            h3[j] = clip(z3[j]);
+        }
+        float y = outputBias.w[0];
+        for (int i = 0; i < L3; i++)
+            y += output.w[i] * h3[i];
+
+        float error = y - s.target;
+        if (!learn)
+            return error * error;
+
+        float dy = 2 * error / BATCH;
+        float d3[L3], d2[L2], dx[X];
+        outputBias.grad[0] += dy;
+        for (int i = 0; i < L3; i++) {
+            output.grad[i] += dy * h3[i];
+            d3[i] = (z3[i] > 0 && z3[i] < 1) ? dy * output.w[i] : 0;
+        }
+        fill(d2, d2 + L2, 0.0f);
+        for (int j = 0; j < L3; j++) {
+            l3Bias.grad[j] += d3[j];
+            for (int i = 0; i < L2; i++) {
+                l3.grad[j * L2 + i] += d3[j] * h2[i];
+                d2[i] += d3[j] * l3.w[j * L2 + i];
+            }
+        }
+        for (int i = 0; i < L2; i++)
+            d2[i] = (z2[i] > 0 && z2[i] < 1) ? d2[i] : 0;
+        fill(dx, dx + X, 0.0f);
+        for (int j = 0; j < L2; j++) {
+            l2Bias.grad[j] += d2[j];
+            for (int i = 0; i < X; i++) {
+                l2.grad[j * X + i] += d2[j] * x[i];
+                dx[i] += d2[j] * l2.w[j * X + i];
+            }
+        }
+        for (int i = 0; i < X; i++)
+            dx[i] = (acc[i] > 0 && acc[i] < 1) ? dx[i] : 0;
+        for (int p = 0; p < 2; p++) {
+            for (int i = 0; i < H; i++)
+                hiddenBias.grad[i] += dx[p * H + i];
+            for (int f = 0; f < counts[p]; f++)
+                for (int i = 0; i < H; i++)
+                    hidden.grad[features[p][f] * H + i] += dx[p * H + i];
+        }
+        return error * error;
+    }
+
+    void step(int t) {
+        Param *params[] = {&hiddenBias, &hidden, &l2Bias, &l2, &l3Bias, &l3,
+                           &outputBias, &output};
+        for (Param *p : params)
+            p->step(t);
+    }
+
+    void quantize(NnueWeights *q) {
+        const double act = NNUE_ACTIVATION_MAX, wt = 1 << NNUE_WEIGHT_SHIFT;
+        for (int i = 0; i < H; i++)
+            q->hiddenBias[i] = (int16_t) lround(hiddenBias.w[i] * act);
+        for (int f = 0; f < NNUE_INPUTS; f++)
+            for (int i = 0; i < H; i++)
+                q->hidden[f][i] = (int16_t) lround(hidden.w[f * H + i] * act);
+        for (int j = 0; j < L2; j++) {
+            q->l2Bias[j] = (int32_t) lround(l2Bias.w[j] * act * wt);
+            for (int i = 0; i < X; i++)
+                q->l2[j][i] = (int8_t) lround(l2.w[j * X + i] * wt);
+        }
+        for (int j = 0; j < L3; j++) {
+            q->l3Bias[j] = (int32_t) lround(l3Bias.w[j] * act * wt);
+            for (int i = 0; i < L2; i++)
+                q->l3[j][i] = (int8_t) lround(l3.w[j * L2 + i] * wt);
+        }
+        q->outputBias = (int32_t) lround(outputBias.w[0] * act * wt);
+        for (int i = 0; i < L3; i++)
+            q->output[i] = (int8_t) lround(output.w[i] * wt);
+        q->prepare();
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "usage: %s out [positions] [epochs]\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    int count = (argc > 2) ? atoi(argv[2]) : DEFAULT_POSITIONS;
+    int epochs = (argc > 3) ? atoi(argv[3]) : DEFAULT_EPOCHS;
+
+    vector<Sample> samples;
+    generate(count, &samples);
+    int validation = count / 20;
+    printf("%d positions, %d held out\n", count, validation);
+
+    Network net;
+    int t = 0;
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        shuffle(samples.begin() + validation, samples.end(), rng);
+        double loss = 0;
+        int n = 0;
+        for (int i = validation; i + BATCH <= count; i += BATCH) {
+            for (int b = 0; b < BATCH; b++)
+                loss += net.train(samples[i + b], rng() % 8, true);
+            n += BATCH;
+            net.step(++t);
+        }
+
+        double held = 0;
+        for (int i = 0; i < validation; i++)
+            held += net.train(samples[i], 0, false);
+        printf("epoch %d: train %.5f, held out %.5f (rms %.2f discs)\n", epoch + 1,
+               loss / n, held / validation,
+               sqrt(held / validation) * NNUE_OUTPUT_DISCS);
+    }
+
+    // Check the quantized network against the float one on held out data
+    NnueWeights *weights = new NnueWeights();
+    net.quantize(weights);
+    NnueEvaluator evaluator(weights);
+    double error = 0;
+    for (int i = 0; i < validation; i++) {
+        evaluator.refresh(samples[i].own, samples[i].opp);
+        double d = evaluator.evaluate(BLACK) / NNUE_OUTPUT_DISCS - samples[i].target;
+        error += d * d;
+    }
+    printf("quantized: held out %.5f (rms %.2f discs)\n", error / validation,
+           sqrt(error / validation) * NNUE_OUTPUT_DISCS);
+
+    bool ok = weights->save(path);
+    printf(ok ? "wrote %s\n" : "cannot write %s\n", path);
+    delete weights;
+    return ok ? 0 : 1;
+}
@@ -1,11 +1,96 @@
+#include <cstdlib>
+#include <cstring>
 #include "player.hpp"
 
+// Time kept in hand on top of the estimated per-turn overhead
+#define SAFETY_MS 5
+// Never plan for less than this; depth 1 is always attempted
+#define MIN_BUDGET_MS 1.0
+// Transposition table a game asks the memory budget for, and the smallest
+// one worth having
+#define TT_BYTES ((size_t) 64 << 20)
+#define TT_MIN_BYTES ((size_t) 1 << 20)
+// Nodes in the MCTS arena (about 24 bytes each)
+#define MCTS_NODES (1 << 20)
+#define MCTS_MIN_NODES (1 << 14)
+// Ring buffer between the search and the trace writer thread
+#define TRACE_BUFFER_BYTES ((size_t) 4 << 20)
+
+/*
+ * Looks up an engine by its command-line name. Returns false if unknown.
+ */
+bool parseEngine(const char *name, Engine *engine)
+{
+    const char *names[] = {"random", "heuristic", "minimax", "mcts"};
+    for (int i = 0; i < 4; i++)
+    {
+        if (!strcmp(name, names[i]))
+        {
+            *engine = (Engine) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Looks up an evaluator by name. Returns false if unknown.
+ */
+bool parseEvaluator(const char *name, Evaluator *evaluator)
+{
+    if (!strcmp(name, "heuristic"))
+        *evaluator = HEURISTIC_EVAL;
+    else if (!strcmp(name, "nnue"))
+        *evaluator = NNUE_EVAL;
+    else
+        return false;
+    return true;
+}
+
+/*
+ * Loads the neural evaluator's weights from the file named in the
+ * environment or the default one next to us, charging them to the memory
+ * budget. A failure is reported on stderr, and minimax then plays with the
+ * heuristic.
+ */
+static const NnueWeights *loadSharedNnueWeights()
+{
+    MemoryManager &memory = MemoryManager::instance();
+    const char *path = getenv(NNUE_PATH_ENV);
+    if (path == nullptr)
+        path = NNUE_DEFAULT_PATH;
+
+    NnueWeights *weights = nullptr;
+    size_t bytes = memory.reserve(sizeof(NnueWeights), sizeof(NnueWeights));
+    if (bytes > 0)
+        weights = loadNnueWeights(path);
+    if (weights == nullptr)
+    {
+        memory.release(bytes);
+        cerr << "cannot load evaluator weights from " << path
+             << "; minimax uses the heuristic" << endl;
+    }
+    return weights;
+}
+
+/*
+ * The neural evaluator's weights, loaded once per process and shared by
+ * every Player; nullptr if they didn't load. Drivers call this at startup
+ * so that the load isn't on a game's clock.
+ */
+const NnueWeights *sharedNnueWeights()
+{
+    static const NnueWeights *weights = loadSharedNnueWeights();
+    return weights;
+}
+
 /*
  * Constructor for the player; initialize everything here. The side your AI is
- * on (BLACK or WHITE) is passed in as "side". The constructor must finish
- * within 30 seconds.
+ * on (BLACK or WHITE) is passed in as "side", and the engine it plays with
+ * as "engine", so that its tables are allocated here rather than on the
+ * first move's clock. The constructor must finish within 30 seconds.
  */
-Player::Player(Side side)
+Player::Player(Side side, Engine engine) : mcts(0)
 {
     // Will be set to true in test_minimax.cpp.
     testingMinimax = false;
@@ -22,9 +107,48 @@ Player::Player(Side side)
     else
         opponentsSide = BLACK;
 
-    // Globals for minimax implementation
-    bestMove = nullptr;
-    test = aiBoard->copy();
+    // Play on one thread unless told otherwise
+    this->engine = engine;
+    searchThreads = 1;
+    extensions = true;
+
+    // Quiescence pays for its nodes at fixed depth but not at equal time
+    // with the network (see testsmall), so it is opt-in
+    quiescence = false;
+
+    // Tables are sized from the memory budget below
+    tt = nullptr;
+    mctsBytes = 0;
+    trace = nullptr;
+    traceBytes = 0;
+    peakResident = 0;
+    residentTotal = 0;
+    residentSamples = 0;
+    tableShrinks = 0;
+
+    // The weights are shared; each game only needs its own accumulators
+    MemoryManager &memory = MemoryManager::instance();
+    const NnueWeights *nnueWeights = sharedNnueWeights();
+    nnue = nullptr;
+    nnueBytes = 0;
+    if (nnueWeights != nullptr)
+        nnueBytes = memory.reserve(sizeof(NnueEvaluator), sizeof(NnueEvaluator));
+    if (nnueBytes > 0)
+        nnue = new NnueEvaluator(nnueWeights);
+
+    // The evaluator can be picked through the environment
+    evaluator = NNUE_EVAL;
+    const char *evalName = getenv(EVAL_ENV);
+    if (evalName != nullptr && !parseEvaluator(evalName, &evaluator))
+        cerr << "unknown evaluator " << evalName << endl;
+
+    allocateTables();
+
+    // Time control; the driver may override these through startClock
+    clockStarted = false;
+    overheadMs = 0;
+    lastDepth = 0;
+    lastNodes = 0;
 }
 
 /*
@@ -32,8 +156,42 @@ Player::Player(Side side)
  */
 Player::~Player()
 {
+    MemoryManager::instance().release(tableBytes());
     delete aiBoard;
-    delete test;
+    delete trace;
+    delete tt;
+    delete nnue;
+}
+
+/*
+ * Records every minimax search of this player to a binary trace file at
+ * path (see trace.hpp), keeping the searched tree down to treeDepth plies.
+ * Returns false if the file can't be created or the memory budget can't
+ * spare the buffer.
+ */
+bool Player::enableTrace(const char *path, int treeDepth)
+{
+    MemoryManager &memory = MemoryManager::instance();
+
+    delete trace;
+    trace = nullptr;
+    if (traceBytes == 0)
+        traceBytes = memory.reserve(TRACE_BUFFER_BYTES, TRACE_BUFFER_BYTES);
+
+    if (traceBytes > 0)
+        trace = new TraceRecorder(path, treeDepth, traceBytes);
+    if (trace != nullptr && !trace->isOpen())
+    {
+        delete trace;
+        trace = nullptr;
+    }
+    if (trace == nullptr)
+    {
+        memory.release(traceBytes);
+        traceBytes = 0;
+    }
+    search.trace = trace;
+    return trace != nullptr;
 }
 
 /*
@@ -53,14 +211,28 @@ Move *Player::doMove(Move *opponentsMove, int msLeft)
 {
     Move *move;
 
+    switch (engine)
+    {
     // Simplest possible move - random choice
-    // move = doRandomMove(opponentsMove, msLeft);
+    case RANDOM_ENGINE:
+        move = doRandomMove(opponentsMove, msLeft);
+        break;
 
     // Beat SimplePlayer - use heuristics
-    // move = doHeuristicMove(opponentsMove, msLeft);
+    case HEURISTIC_ENGINE:
+        move = doHeuristicMove(opponentsMove, msLeft);
+        break;
+
+    // Sampling opponent - Monte Carlo tree search
+    case MCTS_ENGINE:
+        move = doMctsMove(opponentsMove, msLeft);
+        break;
 
     // Further improve AI - use minimax
-    move = doMinimaxMove(opponentsMove, msLeft);
+    default:
+        move = doMinimaxMove(opponentsMove, msLeft);
+        break;
+    }
 
     return move;
 }
@@ -80,11 +252,11 @@ Move *Player::doRandomMove(Move *opponentsMove, int msLeft)
     {
         for (int j = 0; j < 8; j++)
         {
-            Move *move = new Move(i, j);
-            if (aiBoard->checkMove(move, aiSide))
+            Move move(i, j);
+            if (aiBoard->checkMove(&move, aiSide))
             {
-                aiBoard->doMove(move, aiSide);
-                return move;
+                aiBoard->doMove(&move, aiSide);
+                return new Move(i, j);
             }
         }
     }
@@ -112,16 +284,16 @@ Move *Player::doHeuristicMove(Move *opponentsMove, int msLeft)
     {
         for (int j = 0; j < 8; j++)
         {
-            Move *move = new Move(i, j);
-            if (aiBoard->checkMove(move, aiSide))
+            Move move(i, j);
+            if (aiBoard->checkMove(&move, aiSide))
             {
                 testBoard = aiBoard->copy();
-                testBoard->doMove(move, aiSide);
+                testBoard->doMove(&move, aiSide);
                 tempValue = testBoard->getHeuristicValue(aiSide);
                 if (tempValue > maxValue)
                 {
-                    x = move->getX();
-                    y = move->getY();
+                    x = move.getX();
+                    y = move.getY();
                     maxValue = tempValue;
                 }
                 delete testBoard;
@@ -139,112 +311,204 @@ Move *Player::doHeuristicMove(Move *opponentsMove, int msLeft)
 }
 
 /*
- * Compute best move given opponents move
- * Use 2-ply minimax to predict game state two sets of moves ahead
- * Pick move which leads to best final game state
+ * Tells the player when the current request was received and how much time
+ * the driver expects to lose per turn outside of doMove (see LatencyTracker).
+ * Without a call, the clock starts when doMove is entered with no overhead.
  */
-Move *Player::doMinimaxMove(Move *opponentsMove, int msLeft)
+void Player::startClock(Clock::time_point received, int overheadMs)
 {
-    double score;
+    turnStart = received;
+    this->overheadMs = overheadMs;
+    clockStarted = true;
+}
 
-    // Update disposable board to reflect current board state
-    test = aiBoard->copy();
+/*
+ * Milliseconds we can afford to spend on this move. The remaining time is
+ * split evenly over our remaining moves after reserving the expected
+ * per-turn overhead for each of them.
+ */
+double Player::moveBudget(int msLeft)
+{
+    int movesLeft = max((aiBoard->countEmpty() + 1) / 2, 1);
+
+    double usable = msLeft - (double) overheadMs * movesLeft - SAFETY_MS;
+    double budget = usable / movesLeft;
+
+    return max(budget, MIN_BUDGET_MS);
+}
 
-    // Reset bestMove
-    bestMove = nullptr;
+/*
+ * Common start of a searching move: fixes when the turn started and plays
+ * the opponent's move. Returns the deadline for this move, without a limit
+ * if the search should not be timed.
+ */
+Deadline Player::beginTurn(Move *opponentsMove, int msLeft)
+{
+    if (!clockStarted)
+        turnStart = Clock::now();
+    clockStarted = false;
 
     // Populate board with opponent's move
     aiBoard->doMove(opponentsMove, opponentsSide);
 
-    // Determine depth to search to
-    int depth;
-    if (aiSide == BLACK)
-        depth = 4;
-    else
-        depth = 5;
+    manageMemory();
 
+    Deadline deadline;
+    if (msLeft >= 0 && !testingMinimax)
+        deadline.set(turnStart, moveBudget(msLeft));
+    return deadline;
+}
 
-    if (testingMinimax)
-        score = negamax(opponentsMove, 2, opponentsSide, -DBL_MAX, DBL_MAX);
-    else
-        score = negamax(opponentsMove, 4, opponentsSide, -DBL_MAX, DBL_MAX);
+/*
+ * Sizes the tables of the current engine from the memory budget, unless it
+ * already has them. The constructor does this for the engine it is given;
+ * if the engine is changed later, the first turn with it pays instead. With
+ * no budget left the engines play on without their tables.
+ */
+void Player::allocateTables()
+{
+    MemoryManager &memory = MemoryManager::instance();
 
-    if (bestMove != nullptr)
-        aiBoard->doMove(bestMove, aiSide);
+    if (engine == MINIMAX_ENGINE && tt == nullptr)
+    {
+        size_t granted = memory.reserve(TT_BYTES, TT_MIN_BYTES);
+        tt = new TranspositionTable(granted);
+        memory.release(granted - tt->bytes());
+        if (tt->bytes() == 0)
+        {
+            delete tt;
+            tt = nullptr;
+        }
+        search.tt = tt;
+    }
 
-    return bestMove;
+    if (engine == MCTS_ENGINE && mctsBytes == 0)
+    {
+        size_t granted = memory.reserve(MCTS_NODES * sizeof(MctsNode),
+                                        MCTS_MIN_NODES * sizeof(MctsNode));
+        mctsBytes = mcts.resize(granted / sizeof(MctsNode)) * sizeof(MctsNode);
+        memory.release(granted - mctsBytes);
+    }
 }
 
-double Player::negamax(Move *move, int depth, Side side, double alpha, double beta)
+/*
+ * Samples the resident set for the end-of-game report and halves the tables
+ * whenever the process nears its memory limit.
+ */
+void Player::manageMemory()
 {
-    // Make current move to test cases
-    test->doMove(move, side);
+    MemoryManager &memory = MemoryManager::instance();
+
+    allocateTables();
+    sampleResident();
 
-    Board *originalTest = test->copy();
+    if (!memory.underPressure())
+        return;
 
-    // Base case for recursion - no possible moves or reached depth needed
-    if (test->isDone() || depth <= 0)
+    if (tt != nullptr && tt->bytes() > TT_MIN_BYTES)
     {
-        // Determine which heuristic to use
-        if (testingMinimax)
-            return test->getNaiveHeuristic(move, side);
-        else
-            return test->getHeuristicValue(side);
+        size_t before = tt->bytes();
+        tt->resize(before / 2);
+        memory.release(before - tt->bytes());
+        tableShrinks++;
     }
+    if (mctsBytes > MCTS_MIN_NODES * sizeof(MctsNode))
+    {
+        size_t before = mctsBytes;
+        int nodes = before / sizeof(MctsNode) / 2;
+        mctsBytes = mcts.resize(nodes) * sizeof(MctsNode);
+        memory.release(before - mctsBytes);
+        tableShrinks++;
+    }
+}
 
-    std::vector<double> scores;
+/*
+ * Adds the current resident set to the game's statistics. Taken when a turn
+ * starts and again when its search is done: with the tables allocated up
+ * front a search only grows the stack, so the two bracket what a turn uses.
+ * Anything briefly higher in between still shows in the process peak from
+ * getrusage that printMemoryReport adds.
+ */
+void Player::sampleResident()
+{
+    size_t resident = MemoryManager::instance().residentBytes();
+    peakResident = max(peakResident, resident);
+    residentTotal += resident;
+    residentSamples++;
+}
 
-    double best = -DBL_MAX;
+/*
+ * Average resident set over the samples taken so far.
+ */
+size_t Player::steadyResident()
+{
+    return residentSamples ? residentTotal / residentSamples : 0;
+}
 
-    // Switch side
-    if (side == BLACK)
-        side = WHITE;
-    else
-        side = BLACK;
+/*
+ * Bytes of the memory budget this player holds for its tables.
+ */
+size_t Player::tableBytes()
+{
+    return (tt ? tt->bytes() : 0) + mctsBytes + traceBytes + nnueBytes;
+}
 
-    // Get possible moves for other player (side has been switched)
-    std::vector<Move *> possibles = test->possibleMoves(side);
+/*
+ * Compute best move given opponents move
+ * Use iterative deepening negamax, going as deep as the time budget allows
+ * Pick move which leads to best final game state
+ */
+Move *Player::doMinimaxMove(Move *opponentsMove, int msLeft)
+{
+    search.deadline = beginTurn(opponentsMove, msLeft);
 
-    depth -= 1;
+    // Determine depth to search to
+    int maxDepth;
+    if (testingMinimax)
+        maxDepth = 2;
+    else if (search.deadline.limited())
+        maxDepth = aiBoard->countEmpty();
+    else
+        maxDepth = 4;
 
-    // Find best move in possibles
-    for (unsigned int i = 0; i < possibles.size(); i++)
-    {
-        double score = -negamax(possibles[i], depth, side, -beta, -alpha);
-        scores.push_back(score);
-        best = max(best, score);
-        alpha = max(alpha, score);
+    search.naiveEval = testingMinimax;
+    search.quiescence = quiescence && !testingMinimax;
+    search.extensions = extensions && !testingMinimax;
+    search.nnue = (evaluator == NNUE_EVAL) ? nnue : nullptr;
 
-        delete test;
-        test = originalTest->copy();
+    int square = search.findMove(aiBoard, aiSide, maxDepth);
+    lastDepth = search.lastDepth;
+    lastNodes = search.nodes;
+    sampleResident();
 
-        if (alpha >= beta)
-            break;
-    }
+    if (square < 0)
+        return nullptr;
 
-    delete originalTest;
+    Move *bestMove = new Move(square % 8, square / 8);
+    aiBoard->doMove(bestMove, aiSide);
 
-    Move *oldBest = bestMove;
+    return bestMove;
+}
 
-    unsigned int j;
-    for (j = 0; j < scores.size(); j++)
-    {
-        if (scores[j] == best)
-        {
-            bestMove = possibles[j];
-            break;
-        }
-    }
+/*
+ * Compute best move given opponents move
+ * Use Monte Carlo tree search for as long as the time budget allows
+ * Pick the move that was explored most
+ */
+Move *Player::doMctsMove(Move *opponentsMove, int msLeft)
+{
+    mcts.deadline = beginTurn(opponentsMove, msLeft);
 
-    for (unsigned int k = 0; k < possibles.size(); k++)
-    {
-        if (k != j)
-            delete possibles[k];
-    }
-    possibles.clear();
+    int square = mcts.findMove(aiBoard, aiSide, searchThreads);
+    lastDepth = mcts.maxDepth.load();
+    lastNodes = mcts.playouts.load();
+    sampleResident();
 
-    if (bestMove == oldBest)
-        bestMove = nullptr;
+    if (square < 0)
+        return nullptr;
 
-    return best;
+    Move *bestMove = new Move(square % 8, square / 8);
+    aiBoard->doMove(bestMove, aiSide);
+
+    return bestMove;
 }
@@ -6,19 +6,44 @@
 #include <cfloat>
 #include "common.hpp"
 #include "board.hpp"
+#include "search.hpp"
+#include "mcts.hpp"
+#include "timer.hpp"
+#include "memory.hpp"
 using namespace std;
 
+// Ways Player::doMove can pick a move
+enum Engine {
+    RANDOM_ENGINE, HEURISTIC_ENGINE, MINIMAX_ENGINE, MCTS_ENGINE
+};
+
+bool parseEngine(const char *name, Engine *engine);
+
+// Leaf evaluations minimax can use
+enum Evaluator {
+    HEURISTIC_EVAL, NNUE_EVAL
+};
+
+// Environment variable naming the evaluator desdemona starts with
+#define EVAL_ENV "DESDEMONA_EVAL"
+
+bool parseEvaluator(const char *name, Evaluator *evaluator);
+const NnueWeights *sharedNnueWeights();
+
 class Player {
 
 public:
-    Player(Side side);
+    Player(Side side, Engine engine = MINIMAX_ENGINE);
     ~Player();
 
     Move *doMove(Move *opponentsMove, int msLeft);
     Move *doRandomMove(Move *opponentsMove, int msLeft);
     Move *doHeuristicMove(Move *opponentsMove, int msLeft);
     Move *doMinimaxMove(Move *opponentsMove, int msLeft);
-    double negamax(Move *move, int depth, Side side, double alpha, double beta);
+    Move *doMctsMove(Move *opponentsMove, int msLeft);
+
+    void startClock(Clock::time_point received, int overheadMs);
+    bool enableTrace(const char *path, int treeDepth);
 
     // Flag to tell if the player is running within the test_minimax context
     bool testingMinimax;
@@ -26,8 +51,53 @@ public:
     Board *aiBoard;
     Side aiSide;
     Side opponentsSide;
-    Move *bestMove;
-    Board *test;
+
+    // Engine used by doMove, and threads it may use
+    Engine engine;
+    int searchThreads;
+
+    // Horizon quiescence (off by default) and single-reply extensions (on)
+    // for minimax
+    bool quiescence;
+    bool extensions;
+
+    // Evaluation minimax uses; NNUE_EVAL plays with the heuristic if the
+    // weights didn't load
+    Evaluator evaluator;
+
+    // Statistics of the last search, for the driver's per-turn report
+    int lastDepth;
+    long long lastNodes;
+
+    // Memory use over the game, sampled before and after every search
+    size_t peakResident;
+    size_t steadyResident();
+    size_t tableBytes();
+    int tableShrinks;
+
+private:
+    Deadline beginTurn(Move *opponentsMove, int msLeft);
+    double moveBudget(int msLeft);
+    void allocateTables();
+    void manageMemory();
+    void sampleResident();
+
+    // Engine tables and the bytes of memory budget they hold
+    Search<8> search;
+    TranspositionTable *tt;
+    Mcts<8> mcts;
+    size_t mctsBytes;
+    TraceRecorder *trace;
+    size_t traceBytes;
+    NnueEvaluator *nnue;
+    size_t nnueBytes;
+    size_t residentTotal;
+    int residentSamples;
+
+    // Time control for the current turn
+    Clock::time_point turnStart;
+    bool clockStarted;
+    int overheadMs;
 };
 
 #endif
@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include "search.hpp"
+using namespace std;
+
+// Nodes between clock reads; must be a power of two
+#define CLOCK_CHECK_INTERVAL 64
+
+// Depths inside the search are in fractions of a ply, so that a forced
+// move can cost less than a full ply
+#define PLY 4
+#define SINGLE_REPLY_EXTENSION 3
+// Most extension a single path may collect: two single-reply extensions of
+// 3/4 ply fit, a third doesn't, so a path is at most 1.5 plies deeper
+#define MAX_EXTENSION (2 * PLY)
+
+// Limits on the quiescence search below each horizon node
+#define QUIESCENCE_PLIES 6
+#define QUIESCENCE_NODES 64
+
+template <int N>
+Search<N>::Search() {
+    naiveEval = false;
+    quiescence = false;
+    extensions = false;
+    lastDepth = 0;
+    lastScore = 0;
+    nodes = 0;
+    aborted = false;
+    trace = nullptr;
+    tt = nullptr;
+    nnue = nullptr;
+    ply = 0;
+    extended = 0;
+    quiescenceLeft = 0;
+    quiescenceNodes = 0;
+    extensionCount = 0;
+    searches = 0;
+}
+
+/*
+ * Polled from the search; once the deadline has passed every pending search
+ * call unwinds and the last completed iteration is used.
+ */
+template <int N>
+bool Search<N>::outOfTime() {
+    nodes++;
+    if (!aborted && (nodes & (CLOCK_CHECK_INTERVAL - 1)) == 0 && deadline.passed())
+        aborted = true;
+
+    return aborted;
+}
+
+/*
+ * Static evaluation of board from the point of view of side, the side to move
+ */
+template <int N>
+double Search<N>::evaluate(BoardType *board, Side side) {
+    // Determine which heuristic to use
+    if (naiveEval) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        return board->count(side) - board->count(other);
+    }
+    if (nnue != nullptr)
+        return nnue->evaluate(side);
+    return board->getHeuristicValue(side);
+}
+
+/*
+ * Value of a finished game for side. The naive and neural evaluations are
+ * in discs, so they get the exact final disc difference rather than an
+ * estimate of it; the heuristic keeps its own scale.
+ */
+template <int N>
+double Search<N>::finalValue(BoardType *board, Side side) {
+    if (!naiveEval && nnue == nullptr)
+        return board->getHeuristicValue(side);
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    return board->count(side) - board->count(other);
+}
+
+/*
+ * Plays square for side on child, a copy of the current position, and
+ * moves the neural evaluator's accumulator along with it.
+ */
+template <int N>
+void Search<N>::play(BoardType *child, int square, Side side) {
+    typename BoardType::Word flipped = child->flips(square, side);
+    child->makeMove(square, side, flipped);
+    if (nnue != nullptr)
+        nnue->push(square, flipped, side);
+}
+
+/*
+ * Returns to the position before the last play(); the board copy is simply
+ * dropped by the caller.
+ */
+template <int N>
+void Search<N>::unplay() {
+    if (nnue != nullptr)
+        nnue->pop();
+}
+
+/*
+ * Hash of a position for trace records, so the viewer can spot positions
+ * that were searched more than once.
+ */
+template <int N>
+static uint32_t traceHash(BasicBoard<N> *board, Side side) {
+    uint64_t h = positionKey(board->discs(BLACK), board->discs(WHITE), side);
+    return (uint32_t) (h >> 32) ^ (uint32_t) h;
+}
+
+template <int N>
+void Search<N>::traceSearch(BoardType *board, Side side) {
+    TraceSearch record;
+    memset(&record, 0, sizeof(record));
+    record.type = TRACE_SEARCH;
+    record.boardSize = N;
+    record.side = side;
+    record.budgetMs = deadline.limited() ? (float) deadline.budgetMs() : -1;
+    record.search = ++searches;
+    record.black = board->discs(BLACK);
+    record.white = board->discs(WHITE);
+    trace->write(&record, sizeof(record));
+
+    memset(plyNodes, 0, sizeof(plyNodes));
+    memset(plyCutoffs, 0, sizeof(plyCutoffs));
+    memset(plyFirstCutoffs, 0, sizeof(plyFirstCutoffs));
+}
+
+/*
+ * Emits the cutoff statistics and summary of an iteration, then starts
+ * counting afresh for the next one.
+ */
+template <int N>
+void Search<N>::traceIteration(int depth, int bestSquare, double score) {
+    TraceCutoffs cutoffs;
+    memset(&cutoffs, 0, sizeof(cutoffs));
+    cutoffs.type = TRACE_CUTOFFS;
+    cutoffs.plies = (uint8_t) min(depth + 1, TRACE_MAX_PLY);
+    memcpy(cutoffs.nodes, plyNodes, sizeof(plyNodes));
+    memcpy(cutoffs.cutoffs, plyCutoffs, sizeof(plyCutoffs));
+    memcpy(cutoffs.firstMoveCutoffs, plyFirstCutoffs, sizeof(plyFirstCutoffs));
+    trace->write(&cutoffs, sizeof(cutoffs));
+
+    TraceIteration record;
+    memset(&record, 0, sizeof(record));
+    record.type = TRACE_ITERATION;
+    record.depth = (uint8_t) depth;
+    record.aborted = aborted;
+    record.bestSquare = (int8_t) bestSquare;
+    record.micros = (uint32_t) (msSince(searchStart) * 1000);
+    record.nodes = nodes;
+    record.score = traceFloat(score);
+    trace->write(&record, sizeof(record));
+
+    memset(plyNodes, 0, sizeof(plyNodes));
+    memset(plyCutoffs, 0, sizeof(plyCutoffs));
+    memset(plyFirstCutoffs, 0, sizeof(plyFirstCutoffs));
+}
+
+/*
+ * Searches the position child reached by the move square, the index-th of
+ * count moves at this ply, depth fractional plies deep, and returns its
+ * score for the side that moved.
+ * Records the move when tracing and within the recorder's tree depth.
+ */
+template <int N>
+double Search<N>::searchChild(BoardType *child, int square, int index, int count,
+                              int depth, Side side, double alpha, double beta) {
+    long long before = nodes;
+
+    ply++;
+    double score = -alphaBeta(child, depth, side, -beta, -alpha);
+    ply--;
+
+    if (trace != nullptr && ply < trace->treeDepth && !aborted) {
+        TraceNode record;
+        memset(&record, 0, sizeof(record));
+        record.type = TRACE_NODE;
+        record.ply = (uint8_t) (ply + 1);
+        record.square = (int8_t) square;
+        record.flags = (score >= beta ? TRACE_CUTOFF : 0) |
+                       (square < 0 ? TRACE_PASS : 0);
+        record.index = (uint8_t) index;
+        record.count = (uint8_t) count;
+        record.hash = traceHash(child, side);
+        record.nodes = (uint32_t) min(nodes - before, (long long) UINT32_MAX);
+        record.alpha = traceFloat(alpha);
+        record.beta = traceFloat(beta);
+        record.score = traceFloat(score);
+        trace->write(&record, sizeof(record));
+    }
+    return score;
+}
+
+/*
+ * Returns the best square for side to play on board, searching up to
+ * maxDepth plies or until the deadline, or -1 if side has to pass.
+ */
+template <int N>
+int Search<N>::findMove(BoardType *board, Side side, int maxDepth) {
+    typedef typename BoardType::Word Word;
+
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    int squares[N * N];
+    int count = 0;
+    for (Word m = board->legalMoves(side); m != 0; m &= m - 1)
+        squares[count++] = lowestSquare(m);
+
+    aborted = false;
+    nodes = 0;
+    quiescenceNodes = 0;
+    extensionCount = 0;
+    ply = 0;
+    extended = 0;
+    lastDepth = 0;
+    lastScore = 0;
+    searchStart = Clock::now();
+
+    if (count == 0)
+        return -1;
+
+    // With a single legal move there is nothing to think about
+    if (count == 1)
+        maxDepth = 0;
+
+    if (trace != nullptr)
+        traceSearch(board, side);
+    if (nnue != nullptr)
+        nnue->refresh(board->discs(BLACK), board->discs(WHITE));
+
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        double alpha = -DBL_MAX;
+        int bestIndex = -1;
+
+        for (int i = 0; i < count; i++) {
+            BoardType child = *board;
+            play(&child, squares[i], side);
+            double score = searchChild(&child, squares[i], i, count,
+                                       (depth - 1) * PLY, other, alpha, DBL_MAX);
+            unplay();
+
+            if (aborted)
+                break;
+
+            if (bestIndex < 0 || score > alpha) {
+                alpha = score;
+                bestIndex = i;
+            }
+        }
+
+        if (trace != nullptr)
+            traceIteration(depth, aborted ? -1 : squares[bestIndex], alpha);
+
+        // A partial iteration is discarded; keep the last complete one
+        if (aborted)
+            break;
+
+        // Search the best move first on the next iteration
+        swap(squares[0], squares[bestIndex]);
+        lastDepth = depth;
+        lastScore = alpha;
+
+        // The next iteration takes several times longer, so don't start one
+        // we are unlikely to finish
+        if (deadline.pastShare(0.5))
+            break;
+    }
+
+    return squares[0];
+}
+
+/*
+ * Negamax search with alpha-beta pruning. Returns the value of board for side,
+ * the side to move, searched depth plies deep.
+ */
+template <int N>
+double Search<N>::negamax(BoardType *board, int depth, Side side, double alpha, double beta) {
+    return alphaBeta(board, depth * PLY, side, alpha, beta);
+}
+
+/*
+ * The body of negamax, with depth in fractions of a ply. A position with a
+ * single legal move is searched deeper than its depth would allow, as far
+ * as the path's extension allowance goes.
+ */
+template <int N>
+double Search<N>::alphaBeta(BoardType *board, int depth, Side side, double alpha,
+                            double beta) {
+    typedef typename BoardType::Word Word;
+
+    if (outOfTime())
+        return 0;
+
+    if (trace != nullptr && ply < TRACE_MAX_PLY)
+        plyNodes[ply]++;
+
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word moves = board->legalMoves(side);
+
+    if (moves == 0) {
+        // Game over when neither side can move
+        if (board->legalMoves(other) == 0)
+            return finalValue(board, side);
+
+        // Forced pass; the opponent moves on the same board
+        if (depth > 0)
+            return searchChild(board, -1, 0, 1, depth - PLY, other, alpha, beta);
+    }
+
+    // Base case for recursion - reached depth needed
+    if (depth <= 0) {
+        if (!quiescence)
+            return evaluate(board, side);
+        quiescenceLeft = QUIESCENCE_NODES;
+        return quiesce(board, side, alpha, beta, 0);
+    }
+
+    // A result from another path or an earlier iteration may settle this
+    // node; if not, the move it found best is tried first
+    uint64_t key = 0;
+    int hashMove = -1;
+    if (tt != nullptr) {
+        key = positionKey(board->discs(BLACK), board->discs(WHITE), side);
+        TTEntry *entry = tt->probe(key);
+        if (entry != nullptr) {
+            if (entry->depth >= depth &&
+                (entry->bound == BOUND_EXACT ||
+                 (entry->bound == BOUND_LOWER && entry->score >= beta) ||
+                 (entry->bound == BOUND_UPPER && entry->score <= alpha)))
+                return entry->score;
+            hashMove = entry->move;
+        }
+    }
+
+    int squares[N * N];
+    int count = 0;
+    for (; moves != 0; moves &= moves - 1) {
+        squares[count] = lowestSquare(moves);
+        if (squares[count] == hashMove)
+            swap(squares[count], squares[0]);
+        count++;
+    }
+
+    int childDepth = depth - PLY;
+    int extension = 0;
+    if (extensions && count == 1 &&
+        extended + SINGLE_REPLY_EXTENSION <= MAX_EXTENSION) {
+        extension = SINGLE_REPLY_EXTENSION;
+        extensionCount++;
+    }
+    extended += extension;
+
+    double alphaOriginal = alpha;
+    double best = -DBL_MAX;
+    int bestSquare = -1;
+
+    // Find best move among the legal ones
+    for (int i = 0; i < count; i++) {
+        BoardType child = *board;
+        play(&child, squares[i], side);
+        double score = searchChild(&child, squares[i], i, count,
+                                   childDepth + extension, other, alpha, beta);
+        unplay();
+
+        if (score > best) {
+            best = score;
+            bestSquare = squares[i];
+        }
+        alpha = max(alpha, score);
+
+        if (alpha >= beta || aborted) {
+            if (trace != nullptr && ply < TRACE_MAX_PLY && !aborted) {
+                plyCutoffs[ply]++;
+                if (i == 0)
+                    plyFirstCutoffs[ply]++;
+            }
+            break;
+        }
+    }
+
+    extended -= extension;
+
+    if (tt != nullptr && !aborted) {
+        Bound bound = (best <= alphaOriginal) ? BOUND_UPPER :
+                      (best >= beta) ? BOUND_LOWER : BOUND_EXACT;
+        tt->store(key, depth, best, bound, bestSquare);
+    }
+    return best;
+}
+
+/*
+ * Resolves a horizon node instead of trusting its static value. Corner
+ * captures by the side to move are tried against standing pat on the
+ * static value. If there are none but the opponent threatens to take a
+ * corner, the corner is assumed lost: the capture is played as if the side
+ * to move had passed, and the worst outcome caps the static value. Forced
+ * passes are played out. Each horizon node gets QUIESCENCE_NODES
+ * nodes and QUIESCENCE_PLIES plies at most; past either the static value
+ * is returned.
+ */
+template <int N>
+double Search<N>::quiesce(BoardType *board, Side side, double alpha, double beta,
+                          int depth) {
+    typedef typename BoardType::Word Word;
+
+    if (outOfTime())
+        return 0;
+    quiescenceNodes++;
+    quiescenceLeft--;
+
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word moves = board->legalMoves(side);
+    bool capped = depth >= QUIESCENCE_PLIES || quiescenceLeft <= 0;
+
+    if (moves == 0) {
+        if (board->legalMoves(other) == 0)
+            return finalValue(board, side);
+        if (capped)
+            return evaluate(board, side);
+        return -quiesce(board, other, -beta, -alpha, depth + 1);
+    }
+
+    double best = evaluate(board, side);
+    if (capped)
+        return best;
+
+    Word captures = moves & BoardGeometry<N>::corners();
+    if (captures == 0) {
+        Word threats = board->legalMoves(other) & BoardGeometry<N>::corners();
+        for (; threats != 0 && best > alpha; threats &= threats - 1) {
+            BoardType child = *board;
+            play(&child, lowestSquare(threats), other);
+            best = min(best, quiesce(&child, side, alpha, beta, depth + 1));
+            unplay();
+        }
+        return best;
+    }
+
+    if (best >= beta)
+        return best;
+    alpha = max(alpha, best);
+
+    for (; captures != 0; captures &= captures - 1) {
+        BoardType child = *board;
+        play(&child, lowestSquare(captures), side);
+        double score = -quiesce(&child, other, -beta, -alpha, depth + 1);
+        unplay();
+
+        best = max(best, score);
+        alpha = max(alpha, score);
+        if (alpha >= beta || aborted)
+            break;
+    }
+    return best;
+}
+
+// Board sizes the engine and tests are built for.
+template class Search<4>;
+template class Search<6>;
+template class Search<8>;
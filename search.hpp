@@ -0,0 +1,88 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include "board.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "tt.hpp"
+#include "nnue.hpp"
+
+/*
+ * Iterative deepening negamax with alpha-beta pruning for an N x N board.
+ * Boards are copied on the stack at each ply, so a search never allocates;
+ * the optional transposition table is owned and sized by the caller.
+ */
+template <int N>
+class Search {
+
+public:
+    typedef BasicBoard<N> BoardType;
+
+    Search();
+
+    int findMove(BoardType *board, Side side, int maxDepth);
+    double negamax(BoardType *board, int depth, Side side, double alpha, double beta);
+
+    // Time budget of findMove; iterations run to maxDepth without a limit
+    Deadline deadline;
+
+    // Evaluate leaves by disc difference instead of the full heuristic
+    bool naiveEval;
+
+    // Resolve corner captures, corner threats and passes at the horizon
+    bool quiescence;
+
+    // Search positions with a single legal move deeper
+    bool extensions;
+
+    // Where to record searches; nullptr (the default) records nothing
+    TraceRecorder *trace;
+
+    // Table shared by the searches of one game, for cutoffs and move
+    // ordering across iterations; nullptr searches without. Player sizes it
+    // from the memory budget, as the largest table the engine holds.
+    TranspositionTable *tt;
+
+    // Neural evaluator used instead of the heuristic unless nullptr. Only
+    // findMove sets up its root; callers of negamax must refresh() it.
+    NnueEvaluator *nnue;
+
+    // Statistics of the last findMove
+    int lastDepth;
+    double lastScore;
+    long long nodes;
+    long long quiescenceNodes;
+    long long extensionCount;
+    bool aborted;
+
+private:
+    double evaluate(BoardType *board, Side side);
+    double finalValue(BoardType *board, Side side);
+    void play(BoardType *child, int square, Side side);
+    void unplay();
+    bool outOfTime();
+    double alphaBeta(BoardType *board, int depth, Side side, double alpha, double beta);
+    double quiesce(BoardType *board, Side side, double alpha, double beta, int depth);
+    double searchChild(BoardType *child, int square, int index, int count,
+                       int depth, Side side, double alpha, double beta);
+    void traceSearch(BoardType *board, Side side);
+    void traceIteration(int depth, int bestSquare, double score);
+
+    // Plies below the root of the current search
+    int ply;
+
+    // Extension collected on the current path, and quiescence nodes left
+    // for the current horizon node
+    int extended;
+    int quiescenceLeft;
+
+    // Per-iteration statistics, only kept while tracing
+    uint32_t plyNodes[TRACE_MAX_PLY];
+    uint32_t plyCutoffs[TRACE_MAX_PLY];
+    uint32_t plyFirstCutoffs[TRACE_MAX_PLY];
+    uint32_t searches;
+
+    Clock::time_point searchStart;
+};
+
+#endif
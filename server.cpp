@@ -0,0 +1,357 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "server.hpp"
+#include "player.hpp"
+#include "timer.hpp"
+#include "io.hpp"
+
+// Longest game id accepted, so replies fit a fixed buffer.
+#define MAX_ID_LENGTH 64
+
+enum RequestType {
+    NEW_GAME, MOVE, END_GAME
+};
+
+struct Request {
+    RequestType type;
+    Clock::time_point received;
+    Side side;
+    Engine engine;
+    int x, y, msLeft;
+};
+
+/*
+ * Per-game state. Only the worker currently holding the game (scheduled is
+ * true) touches player and latency; pending is guarded by the queue lock.
+ */
+struct Game {
+    std::string id;
+    Player *player;
+    LatencyTracker latency;
+    std::deque<Request> pending;
+    bool scheduled;
+};
+
+class Server {
+
+public:
+    Server(int threads);
+    ~Server();
+
+    void run();
+
+private:
+    void submit(Game *game, const Request &request);
+    void worker();
+    void process(Game *game, const Request &request);
+    void reply(const std::string &id, const char *text, size_t length);
+    void error(const std::string &id, const char *reason);
+
+    // Games by id; only used by the reader thread.
+    std::map<std::string, Game *> games;
+
+    // Games with pending requests, each queued at most once, so a game is
+    // only ever worked on by one thread at a time.
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::condition_variable drained;
+    std::deque<Game *> runnable;
+    int outstanding;
+    bool stopping;
+
+    std::mutex outputLock;
+    std::vector<std::thread> workers;
+};
+
+Server::Server(int threads) {
+    outstanding = 0;
+    stopping = false;
+    for (int i = 0; i < threads; i++)
+        workers.push_back(std::thread(&Server::worker, this));
+}
+
+/*
+ * Waits for all submitted work, stops the pool and frees any games the
+ * client never ended.
+ */
+Server::~Server() {
+    std::unique_lock<std::mutex> lock(queueLock);
+    drained.wait(lock, [this] { return outstanding == 0; });
+    stopping = true;
+    queueReady.notify_all();
+    lock.unlock();
+
+    for (unsigned int i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    for (std::map<std::string, Game *>::iterator it = games.begin();
+         it != games.end(); ++it) {
+        delete it->second->player;
+        delete it->second;
+    }
+}
+
+/*
+ * Queues a request for its game, making the game runnable if it isn't
+ * already waiting for or held by a worker.
+ */
+void Server::submit(Game *game, const Request &request) {
+    std::lock_guard<std::mutex> lock(queueLock);
+    game->pending.push_back(request);
+    outstanding++;
+    if (!game->scheduled) {
+        game->scheduled = true;
+        runnable.push_back(game);
+        queueReady.notify_one();
+    }
+}
+
+/*
+ * Worker thread: takes one request from the next runnable game, handles it
+ * without holding any lock, then requeues the game if it has more work.
+ */
+void Server::worker() {
+    std::unique_lock<std::mutex> lock(queueLock);
+    while (true) {
+        queueReady.wait(lock, [this] { return stopping || !runnable.empty(); });
+        if (runnable.empty())
+            return;
+
+        Game *game = runnable.front();
+        runnable.pop_front();
+        Request request = game->pending.front();
+        game->pending.pop_front();
+        lock.unlock();
+
+        process(game, request);
+
+        lock.lock();
+        if (request.type == END_GAME) {
+            // The game left the id map when "end" was read, so nothing can
+            // be queued behind this request.
+            delete game->player;
+            delete game;
+        } else if (!game->pending.empty()) {
+            runnable.push_back(game);
+            queueReady.notify_one();
+        } else {
+            game->scheduled = false;
+        }
+
+        if (--outstanding == 0)
+            drained.notify_all();
+    }
+}
+
+/*
+ * Handles a single request for a game on the calling worker thread.
+ */
+void Server::process(Game *game, const Request &request) {
+    char text[32];
+
+    if (request.type == NEW_GAME) {
+        game->player = new Player(request.side, request.engine);
+
+        const char *tracePath = getenv(TRACE_PATH_ENV);
+        if (tracePath != nullptr) {
+            std::string path = std::string(tracePath) + "." + game->id;
+            if (!game->player->enableTrace(path.c_str(), traceDepthSetting()))
+                fprintf(stderr, "cannot write trace to %s\n", path.c_str());
+        }
+        reply(game->id, "ready", 5);
+    } else if (request.type == MOVE) {
+        game->latency.observe(request.msLeft);
+        game->player->startClock(request.received, game->latency.estimate());
+
+        Move opponents(request.x, request.y);
+        Move *opponentsMove = nullptr;
+        if (request.x >= 0 && request.y >= 0)
+            opponentsMove = &opponents;
+
+        Move *playersMove = game->player->doMove(opponentsMove, request.msLeft);
+        reply(game->id, text, formatMove(text, playersMove));
+
+        double thinkMs = msSince(request.received);
+        game->latency.finish(request.msLeft, thinkMs);
+
+        fprintf(stderr, "game %s turn %d: think %.2f ms, depth %d, %lld nodes, "
+                "overhead %.2f ms, reserve %d ms, left %d ms\n",
+                game->id.c_str(), game->latency.turns, thinkMs,
+                game->player->lastDepth, game->player->lastNodes,
+                game->latency.lastOverheadMs, game->latency.estimate(),
+                request.msLeft);
+
+        if (playersMove != nullptr) delete playersMove;
+    } else {
+        std::string label = "game " + game->id + " memory";
+        printMemoryReport(label.c_str(), game->player->peakResident,
+                          game->player->steadyResident(),
+                          game->player->tableBytes(), game->player->tableShrinks);
+        reply(game->id, "ended", 5);
+    }
+}
+
+/*
+ * Writes "<id> <text>" as one line; lines from different workers never
+ * interleave.
+ */
+void Server::reply(const std::string &id, const char *text, size_t length) {
+    char line[MAX_ID_LENGTH + 64];
+    size_t n = id.size();
+    memcpy(line, id.data(), n);
+    line[n++] = ' ';
+    memcpy(line + n, text, length);
+    n += length;
+    line[n++] = '\n';
+
+    std::lock_guard<std::mutex> lock(outputLock);
+    writeAll(STDOUT_FILENO, line, n);
+}
+
+void Server::error(const std::string &id, const char *reason) {
+    char text[48] = "error ";
+    strncat(text, reason, sizeof(text) - 7);
+    reply(id, text, strlen(text));
+}
+
+static bool wordIs(const char *word, size_t length, const char *expected) {
+    return length == strlen(expected) && !strncmp(word, expected, length);
+}
+
+/*
+ * Game ids end up in trace file names, so only letters, digits, '_' and '-'
+ * are allowed.
+ */
+static bool validId(const char *id, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = id[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '-'))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Reader loop: parses requests from stdin, timestamps them on receipt and
+ * hands them to the pool. Returns at end of input.
+ */
+void Server::run() {
+    LineReader input(STDIN_FILENO);
+    char *line;
+
+    while ((line = input.readLine()) != nullptr) {
+        Request request;
+        request.received = Clock::now();
+
+        const char *p = line;
+        size_t verbLength, idLength;
+        const char *verb = parseWord(&p, &verbLength);
+        if (verb == nullptr)
+            continue;
+
+        const char *idText = parseWord(&p, &idLength);
+        if (idText == nullptr) {
+            error("-", "missing game id");
+            continue;
+        }
+        if (idLength > MAX_ID_LENGTH) {
+            error("-", "game id too long");
+            continue;
+        }
+        if (!validId(idText, idLength)) {
+            error("-", "bad game id");
+            continue;
+        }
+        std::string id(idText, idLength);
+        std::map<std::string, Game *>::iterator it = games.find(id);
+
+        if (wordIs(verb, verbLength, "new")) {
+            size_t sideLength;
+            const char *sideText = parseWord(&p, &sideLength);
+            if (sideText == nullptr) {
+                error(id, "missing side");
+                continue;
+            }
+            if (it != games.end()) {
+                error(id, "game already exists");
+                continue;
+            }
+
+            request.engine = MINIMAX_ENGINE;
+            size_t engineLength;
+            const char *engineText = parseWord(&p, &engineLength);
+            if (engineText != nullptr) {
+                std::string name(engineText, engineLength);
+                if (!parseEngine(name.c_str(), &request.engine)) {
+                    error(id, "unknown engine");
+                    continue;
+                }
+            }
+
+            Game *game = new Game();
+            game->id = id;
+            game->player = nullptr;
+            game->scheduled = false;
+            games[id] = game;
+
+            request.type = NEW_GAME;
+            request.side = wordIs(sideText, sideLength, "Black") ? BLACK : WHITE;
+            submit(game, request);
+        } else if (wordIs(verb, verbLength, "move")) {
+            if (!parseInt(&p, &request.x) || !parseInt(&p, &request.y) ||
+                !parseInt(&p, &request.msLeft)) {
+                error(id, "bad move");
+                continue;
+            }
+            if (it == games.end()) {
+                error(id, "unknown game");
+                continue;
+            }
+
+            request.type = MOVE;
+            submit(it->second, request);
+        } else if (wordIs(verb, verbLength, "end")) {
+            if (it == games.end()) {
+                error(id, "unknown game");
+                continue;
+            }
+
+            Game *game = it->second;
+            games.erase(it);
+            request.type = END_GAME;
+            submit(game, request);
+        } else {
+            error(id, "unknown request");
+        }
+    }
+}
+
+/*
+ * Runs the multi-game server on the given number of worker threads until
+ * stdin is closed.
+ */
+int runServer(int threads) {
+    if (threads < 1)
+        threads = 1;
+
+    Server server(threads);
+
+    // Games share the evaluator weights; load them before the first game
+    sharedNnueWeights();
+
+    const char ready[] = "Init done\n";
+    writeAll(STDOUT_FILENO, ready, sizeof(ready) - 1);
+
+    server.run();
+    return 0;
+}
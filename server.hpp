@@ -0,0 +1,22 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+/*
+ * Multi-game server mode: one engine process plays many games at once over
+ * stdin/stdout. Every line names the game it belongs to:
+ *
+ *   new <id> <Black|White> [engine]  ->  <id> ready
+ *   move <id> <x> <y> <msLeft>       ->  <id> <x> <y>   (-1 -1 passes)
+ *   end <id>                         ->  <id> ended
+ *
+ * The engine is one of random, heuristic, minimax (default) or mcts. Game
+ * ids are made of letters, digits, '_' and '-'.
+ *
+ * Malformed requests are answered at once with "<id> error <reason>". Other
+ * replies for one game come back in request order; replies for different
+ * games may come back in any order. Games run on a shared pool of worker
+ * threads and only hold their own search state; static tables are shared.
+ */
+int runServer(int threads);
+
+#endif
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include "common.hpp"
+#include "player.hpp"
+#include "board.hpp"
+#include "timer.hpp"
+
+// Use this file to play two engines against each other, e.g. to compare the
+// strength of MCTS and minimax per CPU-second or to catch regressions.
+//
+//   testmatch [games] [msPerGame] [engineA] [engineB] [threadsA] [threadsB]
+//
+// Engine names take a "-qs" suffix to turn on minimax's horizon quiescence,
+// "-noqs" and "-noext" to turn off quiescence or single-reply extensions, so
+// "minimax-qs minimax" measures what quiescence is worth at equal time, and
+// "-nnue" or "-heuristic" to pick its evaluator. By default they play like
+// desdemona. Colors alternate between games, and
+// each pair of games starts from the same random opening so deterministic
+// engines don't replay one game. A side that runs out of time or returns an
+// illegal move loses the game.
+
+// Random plies played before the engines take over
+#define OPENING_PLIES 4
+
+struct EngineSpec {
+    Engine engine;
+    bool quiescence;
+    bool extensions;
+    Evaluator evaluator;
+};
+
+/*
+ * Parses an engine name with its optional suffixes. Returns false if the
+ * name is unknown.
+ */
+static bool parseSpec(const char *name, EngineSpec *spec) {
+    char base[32];
+    const char *suffix = strchr(name, '-');
+    size_t length = suffix ? (size_t) (suffix - name) : strlen(name);
+    if (length >= sizeof(base))
+        return false;
+    memcpy(base, name, length);
+    base[length] = '\0';
+
+    spec->quiescence = false;
+    spec->extensions = true;
+    spec->evaluator = NNUE_EVAL;
+    while (suffix != nullptr) {
+        const char *next = strchr(suffix + 1, '-');
+        std::string word = next ? std::string(suffix + 1, next) :
+                                  std::string(suffix + 1);
+        if (word == "qs")
+            spec->quiescence = true;
+        else if (word == "noqs")
+            spec->quiescence = false;
+        else if (word == "noext")
+            spec->extensions = false;
+        else if (!parseEvaluator(word.c_str(), &spec->evaluator))
+            return false;
+        suffix = next;
+    }
+    return parseEngine(base, &spec->engine);
+}
+
+static double cpuMs() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * Plays one game from the opening seeded by opening and returns the final
+ * disc difference from engine A's point of view; a forfeit counts as losing
+ * every square.
+ */
+static int playGame(EngineSpec specs[2], int threads[2], bool aIsBlack,
+                    int msPerGame, unsigned int opening, double cpu[2]) {
+    Player *players[2];
+    int msLeft[2];
+    for (int i = 0; i < 2; i++) {
+        Side side = ((i == 0) == aIsBlack) ? BLACK : WHITE;
+        players[i] = new Player(side, specs[i].engine);
+        players[i]->quiescence = specs[i].quiescence;
+        players[i]->extensions = specs[i].extensions;
+        players[i]->evaluator = specs[i].evaluator;
+        players[i]->searchThreads = threads[i];
+        msLeft[i] = msPerGame;
+    }
+
+    Board referee;
+    Side toMove = BLACK;
+    Move *last = nullptr;
+    int forfeit = -1;
+
+    // The players follow the opening on their own boards
+    srand(opening);
+    for (int ply = 0; ply < OPENING_PLIES; ply++) {
+        uint64_t moves = referee.legalMoves(toMove);
+        int pick = rand() % popCount(moves);
+        while (pick-- > 0)
+            moves &= moves - 1;
+        Move move(lowestSquare(moves) % 8, lowestSquare(moves) / 8);
+        referee.doMove(&move, toMove);
+        for (int i = 0; i < 2; i++)
+            players[i]->aiBoard->doMove(&move, toMove);
+        toMove = (toMove == BLACK) ? WHITE : BLACK;
+    }
+
+    while (!referee.isDone()) {
+        int i = ((toMove == BLACK) == aIsBlack) ? 0 : 1;
+
+        Clock::time_point start = Clock::now();
+        double cpuStart = cpuMs();
+        Move *move = players[i]->doMove(last, msLeft[i]);
+        cpu[i] += cpuMs() - cpuStart;
+        msLeft[i] -= (int) ceil(msSince(start));
+
+        if (msLeft[i] < 0 || !referee.checkMove(move, toMove)) {
+            forfeit = i;
+            delete move;
+            break;
+        }
+        referee.doMove(move, toMove);
+
+        delete last;
+        last = move;
+        toMove = (toMove == BLACK) ? WHITE : BLACK;
+    }
+    delete last;
+
+    for (int i = 0; i < 2; i++)
+        delete players[i];
+
+    if (forfeit >= 0)
+        return (forfeit == 0) ? -64 : 64;
+
+    int diff = referee.countBlack() - referee.countWhite();
+    return aIsBlack ? diff : -diff;
+}
+
+int main(int argc, char *argv[]) {
+    int games = (argc > 1) ? atoi(argv[1]) : 10;
+    int msPerGame = (argc > 2) ? atoi(argv[2]) : 10000;
+    EngineSpec specs[2] = {{MCTS_ENGINE, true, true, NNUE_EVAL},
+                           {MINIMAX_ENGINE, true, true, NNUE_EVAL}};
+    const char *names[2] = {"mcts", "minimax"};
+    int threads[2] = {1, 1};
+
+    for (int i = 0; i < 2; i++) {
+        if (argc > 3 + i) {
+            names[i] = argv[3 + i];
+            if (!parseSpec(names[i], &specs[i])) {
+                std::cerr << "unknown engine " << names[i] << std::endl;
+                return 1;
+            }
+        }
+        if (argc > 5 + i)
+            threads[i] = atoi(argv[5 + i]);
+    }
+
+    int wins = 0, draws = 0, losses = 0;
+    double cpu[2] = {0, 0};
+    for (int g = 0; g < games; g++) {
+        bool aIsBlack = (g % 2 == 0);
+        int diff = playGame(specs, threads, aIsBlack, msPerGame, g / 2 + 1, cpu);
+        if (diff > 0) wins++;
+        else if (diff == 0) draws++;
+        else losses++;
+
+        std::cout << "game " << g + 1 << ": " << names[0]
+                  << (aIsBlack ? " (black) " : " (white) ")
+                  << (diff > 0 ? "+" : "") << diff << std::endl;
+    }
+
+    std::cout << names[0] << " vs " << names[1] << ": " << wins << " won, "
+              << draws << " drawn, " << losses << " lost" << std::endl;
+    for (int i = 0; i < 2; i++) {
+        std::cout << names[i] << ": " << cpu[i] / 1000 << " CPU s";
+        if (cpu[i] > 0) {
+            double points = (i == 0) ? wins + 0.5 * draws : losses + 0.5 * draws;
+            std::cout << ", " << points / (cpu[i] / 1000) << " points per CPU s";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
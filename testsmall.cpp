@@ -0,0 +1,435 @@
+#include <iostream>
+#include <cstdlib>
+#include <cfloat>
+#include <cstdio>
+#include <vector>
+#include "board.hpp"
+#include "search.hpp"
+#include "tt.hpp"
+#include "nnue.hpp"
+#include "timer.hpp"
+
+// Use this file to check the templated board and search: move generation on
+// 8x8 against known perft counts, the 8x8 fast path against the generic
+// code, and alpha-beta, with and without a transposition table, against
+// plain minimax by solving 4x4 exhaustively. It finishes with a fixed-depth
+// 6x6 search as a benchmark; pass a depth to change it. Last, it measures
+// what the horizon quiescence and single-reply extensions cost in nodes and
+// gain in move quality on 8x8 positions that can be solved exactly, with
+// each evaluator, at fixed depth and at equal time per move. The
+// neural evaluator is checked with random weights: incremental updates
+// against a fresh accumulator and the AVX2 kernels against scalar code,
+// followed by its speed.
+
+/*
+ * Number of leaf positions depth plies from board. A pass counts as a ply,
+ * and finished games count as one leaf.
+ */
+template <int N>
+static long long perft(BasicBoard<N> board, Side side, int depth, bool passed) {
+    typedef typename BasicBoard<N>::Word Word;
+    if (depth == 0)
+        return 1;
+
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word moves = board.legalMoves(side);
+    if (moves == 0)
+        return passed ? 1 : perft(board, other, depth - 1, true);
+
+    long long total = 0;
+    for (; moves != 0; moves &= moves - 1) {
+        BasicBoard<N> child = board;
+        child.makeMove(lowestSquare(moves), side);
+        total += perft(child, other, depth - 1, false);
+    }
+    return total;
+}
+
+/*
+ * Exact disc difference for side with perfect play, without any pruning.
+ */
+template <int N>
+static int minimax(BasicBoard<N> board, Side side, bool passed) {
+    typedef typename BasicBoard<N>::Word Word;
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    Word moves = board.legalMoves(side);
+    if (moves == 0) {
+        if (passed)
+            return board.count(side) - board.count(other);
+        return -minimax(board, other, true);
+    }
+
+    int best = -N * N;
+    for (; moves != 0; moves &= moves - 1) {
+        BasicBoard<N> child = board;
+        child.makeMove(lowestSquare(moves), side);
+        best = std::max(best, -minimax(child, other, false));
+    }
+    return best;
+}
+
+static bool checkPerft() {
+    const long long expected[] = {1, 4, 12, 56, 244, 1396, 8200, 55092, 390216};
+    bool ok = true;
+    for (int depth = 1; depth <= 8; depth++) {
+        long long got = perft(Board(), BLACK, depth, false);
+        if (got != expected[depth]) {
+            std::cout << "Wrong perft(" << depth << "): got " << got
+                      << ", expected " << expected[depth] << std::endl;
+            ok = false;
+        }
+    }
+    if (ok)
+        std::cout << "Correct 8x8 perft through depth 8" << std::endl;
+    return ok;
+}
+
+static bool checkFastPath() {
+    srand(1);
+    long long positions = 0;
+    for (int game = 0; game < 2000; game++) {
+        Board board;
+        Side side = BLACK;
+        int passes = 0;
+        while (passes < 2) {
+            uint64_t fast = board.legalMoves(side);
+            uint64_t generic = BoardGeometry<8>::moves(board.discs(side),
+                board.discs(side == BLACK ? WHITE : BLACK));
+            positions++;
+            if (fast != generic) {
+                std::cout << "Wrong 8x8 moves: fast path " << std::hex << fast
+                          << ", generic " << generic << std::dec << std::endl;
+                return false;
+            }
+
+            if (fast == 0) {
+                passes++;
+            } else {
+                passes = 0;
+                int pick = rand() % popCount(fast);
+                while (pick-- > 0)
+                    fast &= fast - 1;
+                board.makeMove(lowestSquare(fast), side);
+            }
+            side = (side == BLACK) ? WHITE : BLACK;
+        }
+    }
+    std::cout << "Correct 8x8 fast path on " << positions << " positions"
+              << std::endl;
+    return true;
+}
+
+static bool checkSolve4x4(TranspositionTable *tt) {
+    BasicBoard<4> board;
+    int exact = minimax(board, BLACK, false);
+
+    Search<4> search;
+    search.naiveEval = true;
+    search.tt = tt;
+    BasicBoard<4> copy = board;
+    double value = search.negamax(&copy, 2 * 4 * 4, BLACK, -DBL_MAX, DBL_MAX);
+
+    const char *with = tt ? " with table" : "";
+    if (value != exact) {
+        std::cout << "Wrong 4x4 solve" << with << ": alpha-beta " << value
+                  << ", minimax " << exact << std::endl;
+        return false;
+    }
+    std::cout << "Correct 4x4 solve" << with << ": black " << exact
+              << " with perfect play (" << search.nodes << " nodes)" << std::endl;
+    return true;
+}
+
+static void benchmark6x6(int depth, TranspositionTable *tt) {
+    BasicBoard<6> board;
+    Search<6> search;
+    search.tt = tt;
+
+    Clock::time_point start = Clock::now();
+    int square = search.findMove(&board, BLACK, depth);
+    double ms = msSince(start);
+
+    std::cout << "6x6 depth " << search.lastDepth << (tt ? " with table" : "")
+              << ": move (" << square % 6 << ", " << square / 6 << "), "
+              << search.nodes << " nodes in " << ms << " ms ("
+              << (long long) (search.nodes / (ms / 1000)) << " nodes/s)"
+              << std::endl;
+}
+
+/*
+ * Positions with empties empty squares, and the side to move, from random
+ * games. The side to move always has a choice of moves.
+ */
+static void randomPositions(int count, int empties, std::vector<Board> *boards,
+                            std::vector<Side> *sides) {
+    srand(2);
+    while ((int) boards->size() < count) {
+        Board board;
+        Side side = BLACK;
+        int passes = 0;
+        while (board.countEmpty() > empties && passes < 2) {
+            uint64_t moves = board.legalMoves(side);
+            passes = (moves == 0) ? passes + 1 : 0;
+            if (moves != 0) {
+                int pick = rand() % popCount(moves);
+                while (pick-- > 0)
+                    moves &= moves - 1;
+                board.makeMove(lowestSquare(moves), side);
+            }
+            side = (side == BLACK) ? WHITE : BLACK;
+        }
+        if (board.countEmpty() == empties && popCount(board.legalMoves(side)) >= 2) {
+            boards->push_back(board);
+            sides->push_back(side);
+        }
+    }
+}
+
+/*
+ * Compares plain search with the horizon quiescence and the single-reply
+ * extensions, on late-midgame positions small enough to solve exactly. Each
+ * setting is run with every evaluator, disc count, the heuristic and the
+ * shipped network if it loads, once at a fixed depth and once with the same
+ * time per move, and is scored by how many discs its moves lose against
+ * perfect play.
+ */
+static void benchmarkHorizon(const NnueWeights *shipped) {
+    const int POSITIONS = 100, EMPTIES = 12, DEPTH = 4;
+    const double MS_PER_MOVE = 2;
+    std::vector<Board> boards;
+    std::vector<Side> sides;
+    randomPositions(POSITIONS, EMPTIES, &boards, &sides);
+
+    // Exact value of every move of every position
+    std::vector<std::vector<double> > exact(POSITIONS, std::vector<double>(64));
+    std::vector<double> perfect(POSITIONS, -DBL_MAX);
+    TranspositionTable tt(16 << 20);
+    Search<8> solver;
+    solver.naiveEval = true;
+    solver.tt = &tt;
+    for (int p = 0; p < POSITIONS; p++) {
+        Side other = (sides[p] == BLACK) ? WHITE : BLACK;
+        for (uint64_t m = boards[p].legalMoves(sides[p]); m != 0; m &= m - 1) {
+            Board child = boards[p];
+            child.makeMove(lowestSquare(m), sides[p]);
+            double value = -solver.negamax(&child, 2 * EMPTIES, other,
+                                           -DBL_MAX, DBL_MAX);
+            exact[p][lowestSquare(m)] = value;
+            perfect[p] = std::max(perfect[p], value);
+        }
+    }
+
+    std::cout << "8x8 on " << POSITIONS << " positions with " << EMPTIES
+              << " empties, against perfect play, at depth " << DEPTH
+              << " and at " << MS_PER_MOVE << " ms per move:" << std::endl;
+    const char *evaluators[] = {"discs", "heuristic", "nnue"};
+    const char *names[] = {"plain", "quiescence", "extensions", "both"};
+    NnueEvaluator nnue(shipped);
+    for (int e = 0; e < (shipped ? 3 : 2); e++) {
+        Search<8> search;
+        search.naiveEval = (e == 0);
+        search.nnue = (e == 2) ? &nnue : nullptr;
+        long long plainNodes = 0;
+        for (int config = 0; config < 4; config++) {
+            search.quiescence = (config & 1) != 0;
+            search.extensions = (config & 2) != 0;
+
+            long long nodes = 0, quiescenceNodes = 0, extensionCount = 0;
+            double lost[2] = {0, 0};
+            int best[2] = {0, 0};
+            for (int timed = 0; timed < 2; timed++) {
+                for (int p = 0; p < POSITIONS; p++) {
+                    if (timed)
+                        search.deadline.set(Clock::now(), MS_PER_MOVE);
+                    else
+                        search.deadline.clear();
+                    int square = search.findMove(&boards[p], sides[p],
+                                                 timed ? EMPTIES : DEPTH);
+                    if (!timed) {
+                        nodes += search.nodes;
+                        quiescenceNodes += search.quiescenceNodes;
+                        extensionCount += search.extensionCount;
+                    }
+                    lost[timed] += perfect[p] - exact[p][square];
+                    if (exact[p][square] == perfect[p])
+                        best[timed]++;
+                }
+            }
+            if (config == 0)
+                plainNodes = nodes;
+
+            printf("  %-9s %-10s %8lld nodes (%+6.1f%%), %7lld quiescence, "
+                   "%5lld extensions: %2d best, %5.2f discs lost; timed: %2d "
+                   "best, %5.2f discs lost\n", evaluators[e], names[config],
+                   nodes, 100.0 * (nodes - plainNodes) / plainNodes,
+                   quiescenceNodes, extensionCount, best[0],
+                   lost[0] / POSITIONS, best[1], lost[1] / POSITIONS);
+        }
+    }
+}
+
+/*
+ * Weights in the range a trained network has, from a fixed seed.
+ */
+static NnueWeights *randomNnueWeights() {
+    NnueWeights *w = new NnueWeights();
+    srand(3);
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        w->hiddenBias[i] = (int16_t) (rand() % 129 - 64);
+    for (int f = 0; f < NNUE_INPUTS; f++)
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+            w->hidden[f][i] = (int16_t) (rand() % 129 - 64);
+    for (int j = 0; j < NNUE_L2; j++) {
+        w->l2Bias[j] = rand() % 8001 - 4000;
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+            w->l2[j][i] = (int8_t) (rand() % 255 - 127);
+    }
+    for (int j = 0; j < NNUE_L3; j++) {
+        w->l3Bias[j] = rand() % 8001 - 4000;
+        for (int i = 0; i < NNUE_L2; i++)
+            w->l3[j][i] = (int8_t) (rand() % 255 - 127);
+    }
+    w->outputBias = rand() % 8001 - 4000;
+    for (int i = 0; i < NNUE_L3; i++)
+        w->output[i] = (int8_t) (rand() % 255 - 127);
+    w->prepare();
+    return w;
+}
+
+static bool checkNnue(NnueWeights *weights) {
+    NnueEvaluator incremental(weights), fresh(weights);
+    bool avx2 = nnueHasAvx2();
+    srand(4);
+    long long positions = 0;
+    for (int game = 0; game < 200; game++) {
+        Board board;
+        Side side = BLACK;
+        incremental.refresh(board.discs(BLACK), board.discs(WHITE));
+        int passes = 0;
+        while (passes < 2) {
+            fresh.refresh(board.discs(BLACK), board.discs(WHITE));
+            for (int s = WHITE; s <= BLACK; s++) {
+                incremental.simd = false;
+                fresh.simd = false;
+                double expected = fresh.evaluate((Side) s);
+                double got = incremental.evaluate((Side) s);
+                fresh.simd = avx2;
+                double simd = fresh.evaluate((Side) s);
+                if (got != expected || simd != expected) {
+                    std::cout << "Wrong NNUE evaluation: incremental " << got
+                              << ", AVX2 " << simd << ", expected " << expected
+                              << std::endl;
+                    return false;
+                }
+            }
+            positions++;
+
+            uint64_t moves = board.legalMoves(side);
+            if (moves == 0) {
+                passes++;
+            } else {
+                passes = 0;
+                int pick = rand() % popCount(moves);
+                while (pick-- > 0)
+                    moves &= moves - 1;
+                int square = lowestSquare(moves);
+                uint64_t flipped = board.flips(square, side);
+                board.makeMove(square, side, flipped);
+                incremental.simd = (positions % 2) && avx2;
+                incremental.push(square, flipped, side);
+            }
+            side = (side == BLACK) ? WHITE : BLACK;
+        }
+    }
+    std::cout << "Correct NNUE updates" << (avx2 ? " and AVX2 kernels" : "")
+              << " on " << positions << " positions" << std::endl;
+    return true;
+}
+
+/*
+ * A search to the end of the game with the neural evaluator must score
+ * finished games by their exact disc difference, like the naive one.
+ */
+static bool checkNnueSolve(NnueWeights *weights) {
+    const int POSITIONS = 20, EMPTIES = 10;
+    std::vector<Board> boards;
+    std::vector<Side> sides;
+    randomPositions(POSITIONS, EMPTIES, &boards, &sides);
+
+    NnueEvaluator evaluator(weights);
+    Search<8> naive, neural;
+    naive.naiveEval = true;
+    neural.nnue = &evaluator;
+    for (int p = 0; p < POSITIONS; p++) {
+        Board board = boards[p];
+        double exact = naive.negamax(&board, 2 * EMPTIES, sides[p],
+                                     -DBL_MAX, DBL_MAX);
+        board = boards[p];
+        evaluator.refresh(board.discs(BLACK), board.discs(WHITE));
+        double value = neural.negamax(&board, 2 * EMPTIES, sides[p],
+                                      -DBL_MAX, DBL_MAX);
+        if (value != exact) {
+            std::cout << "Wrong NNUE solve: " << value << ", exact " << exact
+                      << std::endl;
+            return false;
+        }
+    }
+    std::cout << "Correct NNUE solve of " << POSITIONS << " positions with "
+              << EMPTIES << " empties" << std::endl;
+    return true;
+}
+
+/*
+ * Evaluations per second with a move pushed and popped for each, the way
+ * the search uses the evaluator at its leaves.
+ */
+static void benchmarkNnue(NnueWeights *weights) {
+    const int COUNT = 2000000;
+    Board board;
+    NnueEvaluator evaluator(weights);
+    evaluator.refresh(board.discs(BLACK), board.discs(WHITE));
+    uint64_t moves = board.legalMoves(BLACK);
+    int squares[4], n = 0;
+    for (; moves != 0; moves &= moves - 1)
+        squares[n++] = lowestSquare(moves);
+
+    bool modes[2] = {false, true};
+    for (int m = 0; m < (nnueHasAvx2() ? 2 : 1); m++) {
+        evaluator.simd = modes[m];
+        double total = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < COUNT; i++) {
+            int square = squares[i % n];
+            evaluator.push(square, board.flips(square, BLACK), BLACK);
+            total += evaluator.evaluate(WHITE);
+            evaluator.pop();
+        }
+        double ms = msSince(start);
+        printf("NNUE %s: %.1f million evaluations/s (checksum %g)\n",
+               modes[m] ? "AVX2" : "scalar", COUNT / ms / 1000, total);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int depth = (argc > 1) ? atoi(argv[1]) : 10;
+
+    bool ok = checkPerft();
+    ok = checkFastPath() && ok;
+    TranspositionTable tt(16 << 20);
+    ok = checkSolve4x4(nullptr) && ok;
+    ok = checkSolve4x4(&tt) && ok;
+    NnueWeights *weights = randomNnueWeights();
+    ok = checkNnue(weights) && ok;
+    ok = checkNnueSolve(weights) && ok;
+
+    benchmark6x6(depth, nullptr);
+    tt.clear();
+    benchmark6x6(depth, &tt);
+    const NnueWeights *shipped = loadNnueWeights(NNUE_DEFAULT_PATH);
+    benchmarkHorizon(shipped);
+    delete shipped;
+    benchmarkNnue(weights);
+    delete weights;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include <cmath>
+#include "timer.hpp"
+
+// Until we have measured anything, assume a full polling period of the Java
+// wrapper (WrapperPlayer sleeps 100 ms between checks for our reply).
+#define INITIAL_OVERHEAD_MS 100.0
+
+/*
+ * Milliseconds elapsed between two points of the monotonic clock.
+ */
+double msBetween(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/*
+ * Milliseconds elapsed since the given point of the monotonic clock.
+ */
+double msSince(Clock::time_point start) {
+    return msBetween(start, Clock::now());
+}
+
+Deadline::Deadline() {
+    budget = 0;
+    isLimited = false;
+}
+
+/*
+ * Limits the move to budgetMs after start.
+ */
+void Deadline::set(Clock::time_point start, double budgetMs) {
+    this->start = start;
+    budget = budgetMs;
+    end = start + std::chrono::microseconds((long long) (budgetMs * 1000));
+    isLimited = true;
+}
+
+void Deadline::clear() {
+    isLimited = false;
+}
+
+bool Deadline::limited() const {
+    return isLimited;
+}
+
+/*
+ * True once a limited budget is used up; never without a limit.
+ */
+bool Deadline::passed() const {
+    return isLimited && Clock::now() >= end;
+}
+
+/*
+ * True once more than share of a limited budget is used up, for engines
+ * deciding whether another round of work can still finish in time.
+ */
+bool Deadline::pastShare(double share) const {
+    return isLimited && msSince(start) > budget * share;
+}
+
+double Deadline::budgetMs() const {
+    return budget;
+}
+
+LatencyTracker::LatencyTracker() {
+    turns = 0;
+    lastOverheadMs = -1;
+    lastMsLeft = -1;
+    lastThinkMs = 0;
+    estimateMs = INITIAL_OVERHEAD_MS;
+}
+
+/*
+ * Called when a new request arrives with the time the harness says we have
+ * left. Returns the overhead observed for the previous turn, or -1 if it
+ * cannot be measured (first turn or no time limit).
+ */
+double LatencyTracker::observe(int msLeft) {
+    lastOverheadMs = -1;
+    if (lastMsLeft >= 0 && msLeft >= 0) {
+        double sample = (lastMsLeft - msLeft) - lastThinkMs;
+        if (sample < 0)
+            sample = 0;
+        lastOverheadMs = sample;
+
+        // Rise immediately on a slow turn, decay slowly on fast ones: a turn
+        // that overshoots is a loss, one that undershoots only costs depth.
+        estimateMs = fmax(sample, 0.8 * estimateMs + 0.2 * sample);
+    }
+    return lastOverheadMs;
+}
+
+/*
+ * Called once our reply has been written for the request that carried msLeft.
+ */
+void LatencyTracker::finish(int msLeft, double thinkMs) {
+    lastMsLeft = msLeft;
+    lastThinkMs = thinkMs;
+    turns++;
+}
+
+/*
+ * Current per-turn overhead estimate in whole milliseconds, rounded up.
+ */
+int LatencyTracker::estimate() {
+    return (int) ceil(estimateMs);
+}
@@ -0,0 +1,62 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <chrono>
+
+// Monotonic clock used for all time budgeting; never jumps with wall time.
+typedef std::chrono::steady_clock Clock;
+
+double msBetween(Clock::time_point start, Clock::time_point end);
+double msSince(Clock::time_point start);
+
+/*
+ * Time budget of a move: budgetMs from start, or no limit at all. Player
+ * sets one per turn and hands it to whichever engine searches.
+ */
+class Deadline {
+
+public:
+    Deadline();
+
+    void set(Clock::time_point start, double budgetMs);
+    void clear();
+
+    bool limited() const;
+    bool passed() const;
+    bool pastShare(double share) const;
+    double budgetMs() const;
+
+private:
+    Clock::time_point start;
+    Clock::time_point end;
+    double budget;
+    bool isLimited;
+};
+
+/*
+ * Estimates how much of msLeft is lost outside of our own thinking time each
+ * turn (pipe IPC, JVM scheduling and the wrapper's 100 ms polling sleep).
+ *
+ * The Java side charges us for the whole round trip, so the overhead of a
+ * turn is (msLeft at that turn - msLeft at the next turn - time we spent
+ * thinking). It only becomes observable once the following request arrives.
+ */
+class LatencyTracker {
+
+public:
+    LatencyTracker();
+
+    double observe(int msLeft);
+    void finish(int msLeft, double thinkMs);
+    int estimate();
+
+    int turns;
+    double lastOverheadMs;
+
+private:
+    int lastMsLeft;
+    double lastThinkMs;
+    double estimateMs;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <signal.h>
+#include "trace.hpp"
+using namespace std;
+
+// How often the writer thread looks for new records
+#define DRAIN_INTERVAL_MS 5
+
+// Recorders with an open file, for closeTracesOnSignal
+static std::mutex openLock;
+static vector<TraceRecorder *> openRecorders;
+
+/*
+ * Opens path for writing and starts the writer thread. bufferBytes is rounded
+ * up to a power of two. Check isOpen() before use.
+ */
+TraceRecorder::TraceRecorder(const char *path, int treeDepth, size_t bufferBytes) {
+    this->treeDepth = treeDepth;
+    dropped = 0;
+    head.store(0);
+    tail.store(0);
+    stopping.store(false);
+
+    capacity = 1;
+    while (capacity < bufferBytes)
+        capacity <<= 1;
+    ring = nullptr;
+
+    file = fopen(path, "wb");
+    if (file == nullptr)
+        return;
+
+    TraceFileHeader header;
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    fwrite(&header, sizeof(header), 1, file);
+
+    ring = new char[capacity];
+    thread = std::thread(&TraceRecorder::writer, this);
+
+    std::lock_guard<std::mutex> guard(openLock);
+    openRecorders.push_back(this);
+}
+
+TraceRecorder::~TraceRecorder() {
+    {
+        std::lock_guard<std::mutex> guard(openLock);
+        openRecorders.erase(remove(openRecorders.begin(), openRecorders.end(),
+                                   this), openRecorders.end());
+    }
+    close();
+    delete[] ring;
+}
+
+/*
+ * Flushes everything still in the ring and closes the file. Records
+ * written after this are dropped silently.
+ */
+void TraceRecorder::close() {
+    if (file == nullptr)
+        return;
+
+    stopping.store(true);
+    thread.join();
+    fclose(file);
+    file = nullptr;
+
+    if (dropped > 0)
+        fprintf(stderr, "trace: dropped %lld records\n", dropped);
+}
+
+bool TraceRecorder::isOpen() {
+    return file != nullptr;
+}
+
+/*
+ * Appends one record. Only one thread may write to a recorder.
+ */
+void TraceRecorder::write(const void *record, size_t size) {
+    size_t h = head.load(memory_order_relaxed);
+    size_t t = tail.load(memory_order_acquire);
+    if (capacity - (h - t) < size) {
+        dropped++;
+        return;
+    }
+
+    size_t offset = h & (capacity - 1);
+    size_t first = min(size, capacity - offset);
+    memcpy(ring + offset, record, first);
+    memcpy(ring, (const char *) record + first, size - first);
+    head.store(h + size, memory_order_release);
+}
+
+/*
+ * Writes out whatever the producer has published so far. Returns false if
+ * there was nothing.
+ */
+bool TraceRecorder::drain() {
+    size_t t = tail.load(memory_order_relaxed);
+    size_t h = head.load(memory_order_acquire);
+    if (t == h)
+        return false;
+    while (t != h) {
+        size_t offset = t & (capacity - 1);
+        size_t chunk = min(h - t, capacity - offset);
+        fwrite(ring + offset, 1, chunk, file);
+        t += chunk;
+    }
+    tail.store(t, memory_order_release);
+    return true;
+}
+
+/*
+ * Flushes after every batch, so that a process that is killed rather than
+ * shut down still leaves the trace up to its last few milliseconds.
+ */
+void TraceRecorder::writer() {
+    while (!stopping.load()) {
+        if (drain())
+            fflush(file);
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+    }
+    drain();
+}
+
+/*
+ * Waits for a termination signal, closes every open trace and then lets
+ * the signal take its default course.
+ */
+static void signalWaiter(sigset_t signals) {
+    int signal;
+    if (sigwait(&signals, &signal) != 0)
+        return;
+
+    openLock.lock();
+    for (unsigned int i = 0; i < openRecorders.size(); i++)
+        openRecorders[i]->close();
+
+    sigset_t one;
+    sigemptyset(&one);
+    sigaddset(&one, signal);
+    ::signal(signal, SIG_DFL);
+    pthread_sigmask(SIG_UNBLOCK, &one, nullptr);
+    raise(signal);
+}
+
+/*
+ * Makes SIGTERM, SIGINT and SIGHUP close every open trace file before the
+ * process dies, so that a game killed by its harness still leaves a
+ * complete trace. Must be called before any other thread is started, as
+ * they inherit the blocked signals.
+ */
+void closeTracesOnSignal() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread(signalWaiter, signals).detach();
+}
+
+/*
+ * Narrows a score for a record; the search uses +-DBL_MAX for open windows.
+ */
+float traceFloat(double value) {
+    if (value > FLT_MAX)
+        return FLT_MAX;
+    if (value < -FLT_MAX)
+        return -FLT_MAX;
+    return (float) value;
+}
+
+/*
+ * Tree depth asked for through the environment, or the default.
+ */
+int traceDepthSetting() {
+    const char *depth = getenv(TRACE_DEPTH_ENV);
+    return (depth != nullptr) ? atoi(depth) : TRACE_DEFAULT_DEPTH;
+}
@@ -0,0 +1,137 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+/*
+ * Binary search traces. A trace file is a TraceFileHeader followed by a
+ * stream of fixed-size records in native byte order, each starting with its
+ * type byte. For every negamax search there is:
+ *
+ *   TRACE_SEARCH     root position and time budget
+ *   TRACE_NODE       one per searched move down to the recorder's tree
+ *                    depth, in post-order (children before their parent)
+ *   TRACE_CUTOFFS    nodes and beta cutoffs by ply for the iteration
+ *   TRACE_ITERATION  depth, nodes, time and result of the iteration
+ *
+ * with the last three repeated for each iteration. traceview summarizes a
+ * trace file.
+ */
+
+// Environment variables that switch tracing on in desdemona; in server mode
+// each game writes to the path with ".<game id>" appended
+#define TRACE_PATH_ENV "DESDEMONA_TRACE"
+#define TRACE_DEPTH_ENV "DESDEMONA_TRACE_DEPTH"
+#define TRACE_DEFAULT_DEPTH 3
+
+#define TRACE_MAGIC "DTRC"
+#define TRACE_VERSION 1
+#define TRACE_MAX_PLY 64
+
+enum TraceRecordType {
+    TRACE_SEARCH = 1, TRACE_ITERATION = 2, TRACE_NODE = 3, TRACE_CUTOFFS = 4
+};
+
+// TraceNode flags
+#define TRACE_CUTOFF 1      // score >= beta of the parent's window
+#define TRACE_PASS 2        // the move is a pass
+
+struct TraceFileHeader {
+    char magic[4];
+    uint32_t version;
+};
+
+struct TraceSearch {
+    uint8_t type;
+    uint8_t boardSize;
+    uint8_t side;
+    uint8_t pad;
+    float budgetMs;         // -1 when not timed
+    uint32_t search;
+    uint32_t pad2;
+    uint64_t black;
+    uint64_t white;
+};
+
+struct TraceIteration {
+    uint8_t type;
+    uint8_t depth;
+    uint8_t aborted;
+    int8_t bestSquare;
+    uint32_t micros;        // since the search started
+    uint64_t nodes;         // cumulative for the search
+    float score;
+    uint32_t pad;
+};
+
+/*
+ * A searched move. Scores and window are from the point of view of the side
+ * that played it, with the window as it was when the move was tried.
+ */
+struct TraceNode {
+    uint8_t type;
+    uint8_t ply;            // 1 for moves at the root
+    int8_t square;          // -1 for a pass
+    uint8_t flags;
+    uint8_t index;          // position in the parent's move order
+    uint8_t count;          // number of moves the parent had
+    uint16_t pad;
+    uint32_t hash;          // of the position after the move
+    uint32_t nodes;         // size of the subtree
+    float alpha;
+    float beta;
+    float score;
+    uint32_t pad2;
+};
+
+struct TraceCutoffs {
+    uint8_t type;
+    uint8_t plies;
+    uint16_t pad;
+    uint32_t pad2;
+    uint32_t nodes[TRACE_MAX_PLY];
+    uint32_t cutoffs[TRACE_MAX_PLY];
+    uint32_t firstMoveCutoffs[TRACE_MAX_PLY];
+};
+
+/*
+ * Records trace data into a lock-free single-producer ring buffer that a
+ * background thread drains to the file, so the search never waits on I/O.
+ * When the ring is full records are dropped (and counted), not delayed.
+ */
+class TraceRecorder {
+
+public:
+    TraceRecorder(const char *path, int treeDepth, size_t bufferBytes);
+    ~TraceRecorder();
+
+    bool isOpen();
+    void write(const void *record, size_t size);
+    void close();
+
+    // Deepest ply for which TRACE_NODE records are kept
+    int treeDepth;
+
+    long long dropped;
+
+private:
+    void writer();
+    bool drain();
+
+    FILE *file;
+    char *ring;
+    size_t capacity;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+float traceFloat(double value);
+int traceDepthSetting();
+void closeTracesOnSignal();
+
+#endif
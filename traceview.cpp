@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+using namespace std;
+
+// Offline viewer for search traces written by desdemona with
+// DESDEMONA_TRACE set (see trace.hpp). Prints every search with its
+// iterations, then the hotspots over the whole file: cutoff rates by ply,
+// the biggest subtrees, badly ordered nodes and positions searched again.
+//
+//   traceview file [top]
+
+struct Node {
+    TraceNode record;
+    int search;
+    int depth;          // iteration it belongs to
+    int parent;         // index into nodes, -1 for root moves
+    string path;
+};
+
+struct SearchInfo {
+    TraceSearch record;
+    vector<TraceIteration> iterations;
+};
+
+static vector<SearchInfo> searches;
+static vector<Node> nodes;
+static TraceCutoffs totals;
+
+static string squareName(int square, int size) {
+    if (square < 0)
+        return "pass";
+    char name[8];
+    snprintf(name, sizeof(name), "%c%d", 'a' + square % size, square / size + 1);
+    return name;
+}
+
+static int boardSize(const Node &node) {
+    return searches[node.search].record.boardSize;
+}
+
+/*
+ * Links the moves of a finished iteration to their parents and names them.
+ * Records are in post-order, so a node's children are the nodes one ply
+ * deeper that were recorded since the previous node at its own ply.
+ */
+static void finishIteration(int first, int depth) {
+    vector<int> pending;
+    for (int i = first; i < (int) nodes.size(); i++) {
+        nodes[i].depth = depth;
+        nodes[i].parent = -1;
+        while (!pending.empty() &&
+               nodes[pending.back()].record.ply > nodes[i].record.ply) {
+            nodes[pending.back()].parent = i;
+            pending.pop_back();
+        }
+        pending.push_back(i);
+    }
+
+    for (int i = (int) nodes.size() - 1; i >= first; i--) {
+        string move = squareName(nodes[i].record.square, boardSize(nodes[i]));
+        int parent = nodes[i].parent;
+        nodes[i].path = (parent < 0) ? move : nodes[parent].path + " " + move;
+    }
+}
+
+static bool load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, 4) || header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d trace\n", path, TRACE_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    memset(&totals, 0, sizeof(totals));
+    int iterationStart = 0;
+    int type;
+    while ((type = fgetc(file)) != EOF) {
+        ungetc(type, file);
+        bool ok = false;
+        if (type == TRACE_SEARCH) {
+            SearchInfo info;
+            ok = fread(&info.record, sizeof(info.record), 1, file) == 1;
+            searches.push_back(info);
+            iterationStart = nodes.size();
+        } else if (type == TRACE_NODE && !searches.empty()) {
+            Node node;
+            ok = fread(&node.record, sizeof(node.record), 1, file) == 1;
+            node.search = searches.size() - 1;
+            nodes.push_back(node);
+        } else if (type == TRACE_CUTOFFS) {
+            TraceCutoffs cutoffs;
+            ok = fread(&cutoffs, sizeof(cutoffs), 1, file) == 1;
+            for (int p = 0; p < TRACE_MAX_PLY; p++) {
+                totals.nodes[p] += cutoffs.nodes[p];
+                totals.cutoffs[p] += cutoffs.cutoffs[p];
+                totals.firstMoveCutoffs[p] += cutoffs.firstMoveCutoffs[p];
+            }
+        } else if (type == TRACE_ITERATION && !searches.empty()) {
+            TraceIteration iteration;
+            ok = fread(&iteration, sizeof(iteration), 1, file) == 1;
+            searches.back().iterations.push_back(iteration);
+            finishIteration(iterationStart, iteration.depth);
+            iterationStart = nodes.size();
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: bad or truncated record of type %d\n", path, type);
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void printSearches() {
+    for (unsigned int s = 0; s < searches.size(); s++) {
+        TraceSearch &r = searches[s].record;
+        int empties = r.boardSize * r.boardSize -
+            __builtin_popcountll(r.black) - __builtin_popcountll(r.white);
+        printf("search %u: %s to move, %d empties", r.search,
+               r.side ? "black" : "white", empties);
+        if (r.budgetMs >= 0)
+            printf(", budget %.1f ms", r.budgetMs);
+        printf("\n");
+
+        uint64_t previous = 0;
+        double previousSize = 0;
+        for (unsigned int i = 0; i < searches[s].iterations.size(); i++) {
+            TraceIteration &it = searches[s].iterations[i];
+            uint64_t size = it.nodes - previous;
+            printf("  depth %2d: %10llu nodes %9.2f ms", it.depth,
+                   (unsigned long long) size, it.micros / 1000.0);
+            if (previousSize > 0)
+                printf("  x%-5.1f", size / previousSize);
+            else
+                printf("        ");
+            if (it.aborted)
+                printf("  aborted\n");
+            else
+                printf("  best %s score %g\n",
+                       squareName(it.bestSquare, r.boardSize).c_str(), it.score);
+            previous = it.nodes;
+            previousSize = size;
+        }
+    }
+}
+
+static void printCutoffs() {
+    printf("\ncutoffs by ply\n");
+    printf("  ply      nodes    cutoffs   cut%%  first%%\n");
+    for (int p = 0; p < TRACE_MAX_PLY; p++) {
+        if (totals.nodes[p] == 0)
+            continue;
+        double cut = 100.0 * totals.cutoffs[p] / totals.nodes[p];
+        double first = totals.cutoffs[p] ?
+            100.0 * totals.firstMoveCutoffs[p] / totals.cutoffs[p] : 0;
+        printf("  %3d %10u %10u %6.1f %7.1f\n", p, totals.nodes[p],
+               totals.cutoffs[p], cut, first);
+    }
+}
+
+static void printBiggest(unsigned int top) {
+    vector<int> order;
+    for (unsigned int i = 0; i < nodes.size(); i++)
+        order.push_back(i);
+    sort(order.begin(), order.end(), [](int a, int b) {
+        return nodes[a].record.nodes > nodes[b].record.nodes;
+    });
+
+    printf("\nbiggest subtrees\n");
+    for (unsigned int i = 0; i < order.size() && i < top; i++) {
+        Node &n = nodes[order[i]];
+        printf("  %10u nodes  search %u depth %d: %s\n", n.record.nodes,
+               searches[n.search].record.search, n.depth, n.path.c_str());
+    }
+}
+
+/*
+ * A cutoff on the k-th move means the k moves searched before it were
+ * wasted work that better ordering would have skipped.
+ */
+static void printBadlyOrdered(unsigned int top) {
+    vector<pair<uint64_t, int> > waste;
+    map<int, uint64_t> before;      // parent -> nodes of earlier siblings
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Node &n = nodes[i];
+        if (n.parent < 0)
+            continue;
+        if ((n.record.flags & TRACE_CUTOFF) && n.record.index > 0)
+            waste.push_back(make_pair(before[n.parent], (int) i));
+        before[n.parent] += n.record.nodes;
+    }
+    sort(waste.rbegin(), waste.rend());
+
+    printf("\nbadly ordered nodes (cutoff after other moves)\n");
+    for (unsigned int i = 0; i < waste.size() && i < top; i++) {
+        Node &n = nodes[waste[i].second];
+        Node &parent = nodes[n.parent];
+        printf("  %10llu wasted  cut by move %d of %d  search %u depth %d: %s\n",
+               (unsigned long long) waste[i].first, n.record.index + 1,
+               n.record.count, searches[n.search].record.search, n.depth,
+               parent.path.c_str());
+    }
+}
+
+/*
+ * Positions that appear more than once within one iteration, reached
+ * through transpositions. Revisits by the next iteration are expected with
+ * iterative deepening and are not counted.
+ */
+static void printResearched(unsigned int top) {
+    struct Repeat {
+        int first;
+        int visits;
+        uint64_t nodes;
+    };
+    typedef pair<pair<int, int>, uint32_t> Key;     // search, depth, hash
+    map<Key, Repeat> seen;
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Key key(make_pair(nodes[i].search, nodes[i].depth), nodes[i].record.hash);
+        map<Key, Repeat>::iterator it = seen.find(key);
+        if (it == seen.end()) {
+            Repeat r = {(int) i, 1, 0};
+            seen[key] = r;
+        } else {
+            it->second.visits++;
+            it->second.nodes += nodes[i].record.nodes;
+        }
+    }
+
+    vector<Repeat> repeats;
+    uint64_t total = 0;
+    for (map<Key, Repeat>::iterator it = seen.begin();
+         it != seen.end(); ++it) {
+        if (it->second.visits > 1) {
+            repeats.push_back(it->second);
+            total += it->second.nodes;
+        }
+    }
+    sort(repeats.begin(), repeats.end(), [](const Repeat &a, const Repeat &b) {
+        return a.nodes > b.nodes;
+    });
+
+    printf("\npositions re-searched within an iteration: %zu, %llu nodes after "
+           "the first visit\n", repeats.size(), (unsigned long long) total);
+    for (unsigned int i = 0; i < repeats.size() && i < top; i++) {
+        Node &n = nodes[repeats[i].first];
+        printf("  %10llu nodes  %2d visits  search %u depth %d: %s\n",
+               (unsigned long long) repeats[i].nodes, repeats[i].visits,
+               searches[n.search].record.search, n.depth, n.path.c_str());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace [top]\n", argv[0]);
+        return 1;
+    }
+    unsigned int top = (argc > 2) ? atoi(argv[2]) : 10;
+
+    if (!load(argv[1]))
+        return 1;
+
+    printSearches();
+    printCutoffs();
+    printBiggest(top);
+    printBadlyOrdered(top);
+    printResearched(top);
+    return 0;
+}
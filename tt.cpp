@@ -0,0 +1,69 @@
+#include <cstring>
+#include <new>
+#include "tt.hpp"
+
+TranspositionTable::TranspositionTable(size_t bytes) {
+    entries = nullptr;
+    size = 0;
+    resize(bytes);
+}
+
+TranspositionTable::~TranspositionTable() {
+    delete[] entries;
+}
+
+/*
+ * Replaces the table with an empty one of at most bytes.
+ */
+void TranspositionTable::resize(size_t bytes) {
+    delete[] entries;
+    entries = nullptr;
+
+    size = 1;
+    while (size * 2 * sizeof(TTEntry) <= bytes)
+        size *= 2;
+    if (size * sizeof(TTEntry) > bytes)
+        size = 0;
+
+    while (size > 0) {
+        entries = new (std::nothrow) TTEntry[size];
+        if (entries != nullptr)
+            break;
+        size /= 2;
+    }
+    clear();
+}
+
+void TranspositionTable::clear() {
+    if (entries != nullptr)
+        memset(entries, 0, size * sizeof(TTEntry));
+}
+
+size_t TranspositionTable::bytes() {
+    return size * sizeof(TTEntry);
+}
+
+/*
+ * Returns the entry for key, or nullptr if it isn't in the table.
+ */
+TTEntry *TranspositionTable::probe(uint64_t key) {
+    if (size == 0)
+        return nullptr;
+    TTEntry *entry = &entries[key & (size - 1)];
+    return (entry->key == key) ? entry : nullptr;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, double score, Bound bound,
+                               int move) {
+    if (size == 0)
+        return;
+    TTEntry *entry = &entries[key & (size - 1)];
+    if (entry->key == key && entry->depth > depth)
+        return;
+
+    entry->key = key;
+    entry->score = score;
+    entry->depth = (int16_t) depth;
+    entry->bound = (uint8_t) bound;
+    entry->move = (int8_t) move;
+}
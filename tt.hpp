@@ -0,0 +1,58 @@
+#ifndef __TT_H__
+#define __TT_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// What an entry's score says about the true value of its position
+enum Bound {
+    BOUND_EXACT, BOUND_LOWER, BOUND_UPPER
+};
+
+struct TTEntry {
+    uint64_t key;           // 0 for an empty slot
+    double score;
+    int16_t depth;          // in the search's fractional plies
+    uint8_t bound;
+    int8_t move;            // best or refuting square, -1 if none
+};
+
+/*
+ * Hash of a position with side to move, used as the transposition table key
+ * and in trace records. Never 0.
+ */
+inline uint64_t positionKey(uint64_t black, uint64_t white, int side) {
+    uint64_t h = black * 0x9e3779b97f4a7c15ULL;
+    h ^= white * 0xc2b2ae3d27d4eb4fULL + side;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 29;
+    return h | 1;
+}
+
+/*
+ * Fixed-size transposition table for negamax: one entry per slot, a new
+ * result replaces the old one unless it is for the same position at a
+ * lower depth. The size is a power of two no larger than the bytes asked
+ * for; if that can't be allocated it halves until it can, and a table of
+ * size 0 simply never hits.
+ */
+class TranspositionTable {
+
+public:
+    TranspositionTable(size_t bytes);
+    ~TranspositionTable();
+
+    TTEntry *probe(uint64_t key);
+    void store(uint64_t key, int depth, double score, Bound bound, int move);
+
+    void resize(size_t bytes);
+    void clear();
+    size_t bytes();
+
+private:
+    TTEntry *entries;
+    size_t size;
+};
+
+#endif
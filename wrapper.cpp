@@ -1,47 +1,108 @@
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
 #include "player.hpp"
+#include "timer.hpp"
+#include "io.hpp"
+#include "server.hpp"
 using namespace std;
 
 int main(int argc, char *argv[]) {
-    // Read in side the player is on.
-    if (argc != 2)  {
-        cerr << "usage: " << argv[0] << " side" << endl;
+    // The harness may close our pipes before our stdin; a failed write
+    // should end the game loop, not the process, so the player is cleaned up.
+    signal(SIGPIPE, SIG_IGN);
+
+    // A traced game killed by its harness should still leave a whole trace.
+    if (getenv(TRACE_PATH_ENV) != nullptr)
+        closeTracesOnSignal();
+
+    // Serve many games from this one process; see server.hpp.
+    if (argc >= 2 && !strcmp(argv[1], "--server")) {
+        int threads = (argc >= 3) ? atoi(argv[2]) :
+            (int) std::thread::hardware_concurrency();
+        return runServer(threads);
+    }
+
+    // Read in side the player is on, and optionally the engine to use.
+    Engine engine = MINIMAX_ENGINE;
+    if (argc < 2 || argc > 4 || (argc >= 3 && !parseEngine(argv[2], &engine))) {
+        cerr << "usage: " << argv[0] << " side [random|heuristic|minimax|mcts"
+             << " [threads]]" << endl;
+        cerr << "       " << argv[0] << " --server [threads]" << endl;
         exit(-1);
     }
     Side side = (!strcmp(argv[1], "Black")) ? BLACK : WHITE;
 
     // Initialize player.
-    Player *player = new Player(side);
+    Player *player = new Player(side, engine);
+    if (argc == 4)
+        player->searchThreads = atoi(argv[3]);
+
+    // Opt-in search traces for offline profiling with traceview.
+    const char *tracePath = getenv(TRACE_PATH_ENV);
+    if (tracePath != nullptr && !player->enableTrace(tracePath, traceDepthSetting()))
+        cerr << "cannot write trace to " << tracePath << endl;
 
     // Tell java wrapper that we are done initializing.
-    cout << "Init done" << endl;
-    cout.flush();
+    const char ready[] = "Init done\n";
+    writeAll(STDOUT_FILENO, ready, sizeof(ready) - 1);
 
-    int moveX, moveY, msLeft;
+    LineReader input(STDIN_FILENO);
+    LatencyTracker latency;
+    char reply[32];
+    char *line;
 
     // Get opponent's move and time left for player each turn.
-    while (cin >> moveX >> moveY >> msLeft) {
+    while ((line = input.readLine()) != nullptr) {
+        Clock::time_point received = Clock::now();
+
+        int moveX, moveY, msLeft;
+        const char *p = line;
+        if (!parseInt(&p, &moveX) || !parseInt(&p, &moveY) ||
+            !parseInt(&p, &msLeft))
+            break;
+
+        latency.observe(msLeft);
+        player->startClock(received, latency.estimate());
+
         Move *opponentsMove = nullptr;
+        Move opponents(moveX, moveY);
         if (moveX >= 0 && moveY >= 0) {
-            opponentsMove = new Move(moveX, moveY);
+            opponentsMove = &opponents;
         }
 
         // Get player's move and output to java wrapper.
         Move *playersMove = player->doMove(opponentsMove, msLeft);
-        if (playersMove != nullptr) {
-            cout << playersMove->x << " " << playersMove->y << endl;
-        } else {
-            cout << "-1 -1" << endl;
-        }
-        cout.flush();
-        cerr.flush();
+        size_t length = formatMove(reply, playersMove);
+        reply[length++] = '\n';
+        if (!writeAll(STDOUT_FILENO, reply, length))
+            break;
+
+        double thinkMs = msSince(received);
+        latency.finish(msLeft, thinkMs);
+
+        // Per-turn latency and memory report; stderr is unbuffered. The
+        // harness stops reading it once the game is over, so this is the
+        // report it gets.
+        const double MB = 1 << 20;
+        fprintf(stderr, "turn %d: think %.2f ms, depth %d, %lld nodes, "
+                "overhead %.2f ms, reserve %d ms, left %d ms, memory peak "
+                "%.1f MB, steady %.1f MB, tables %.1f MB\n",
+                latency.turns, thinkMs, player->lastDepth, player->lastNodes,
+                latency.lastOverheadMs, latency.estimate(), msLeft,
+                player->peakResident / MB, player->steadyResident() / MB,
+                player->tableBytes() / MB);
 
         // Delete move objects.
-        if (opponentsMove != nullptr) delete opponentsMove;
         if (playersMove != nullptr) delete playersMove;
     }
 
+    printMemoryReport("memory", player->peakResident, player->steadyResident(),
+                      player->tableBytes(), player->tableShrinks);
+    delete player;
     return 0;
 }